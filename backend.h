@@ -0,0 +1,39 @@
+#pragma once
+
+#include <luisa-compute.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace lct
+{
+    // Backend requested through LCT_BACKEND ("cuda", "cpu", "dx", ..., or "host" for the tools that have a native
+    // host path). Empty when unset.
+    inline std::string requested_backend()
+    {
+        auto env = std::getenv("LCT_BACKEND");
+        return env ? std::string(env) : std::string();
+    }
+
+    inline bool host_backend_requested()
+    {
+        return requested_backend() == "host";
+    }
+
+    // Creates the device named by LCT_BACKEND, or the preferred backend when it is installed and the first installed
+    // backend otherwise, so the tools also run on machines without a GPU.
+    inline luisa::compute::Device create_device(luisa::compute::Context &context, std::string_view preferred = "cuda")
+    {
+        auto name = requested_backend();
+        if (name.empty() || name == "host")
+        {
+            auto backends = context.installed_backends();
+            LUISA_ASSERT(!backends.empty(), "No LuisaCompute backend is installed.");
+            auto match = std::find(backends.begin(), backends.end(), preferred);
+            name = match != backends.end() ? std::string(*match) : std::string(backends.front());
+        }
+        return context.create_device(luisa::string(name));
+    }
+}
@@ -0,0 +1,382 @@
+#include <iostream>
+#include <lodepng.h>
+#include <seamcarving.h>
+#include <samplekernels.h>
+#include <imageops.h>
+#include <imageio.h>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+// lct-bench times the seam carving stages, the sampletest kernels, synthetic image generation and PNG encode/decode
+// on synthetic images, so no assets are needed. It runs on the CPU backend unless LCT_BACKEND names another one.
+//
+//   lct-bench [--quick] [--filter <substring>] [--out <results.json>] [--baseline <baseline.json>] [--tolerance <fraction>]
+//
+// --quick stops at 2048x2048. With --baseline, every case whose median is slower than the baseline median by more
+// than the tolerance (default 0.15) is reported and the exit code is 1; record a baseline with --out. CTest runs the
+// quick set against the baseline given by LCT_BENCH_BASELINE at configure time.
+
+struct BenchResult
+{
+    std::string name;
+    double median_ms;
+    double min_ms;
+    uint reps;
+};
+
+class Bench
+{
+    std::string _filter;
+    double _min_time_ms = 250.0;
+    uint _max_reps = 50u;
+
+public:
+    std::vector<BenchResult> results;
+
+    explicit Bench(std::string filter) : _filter(std::move(filter)) {}
+
+    [[nodiscard]] bool selected(const std::string &name) const { return _filter.empty() || name.find(_filter) != std::string::npos; }
+
+    // Times `body` after one warm-up run, repeating until _min_time_ms has been spent or _max_reps reached. `setup`
+    // runs untimed before every run. Both must leave the device idle.
+    void run(const std::string &name, const std::function<void()> &setup, const std::function<void()> &body)
+    {
+        if (!selected(name))
+            return;
+        setup();
+        body();
+        std::vector<double> times;
+        double total_ms = 0.0;
+        while (times.empty() || (times.size() < _max_reps && total_ms < _min_time_ms))
+        {
+            setup();
+            Clock clock;
+            clock.tic();
+            body();
+            times.push_back(clock.toc());
+            total_ms += times.back();
+        }
+        std::sort(times.begin(), times.end());
+        results.push_back({name, times[times.size() / 2u], times.front(), static_cast<uint>(times.size())});
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << results.back().median_ms << " ms" << std::setw(6) << times.size() << " reps\n"
+                  << std::defaultfloat;
+    }
+
+    void run(const std::string &name, const std::function<void()> &body)
+    {
+        run(name, [] {}, body);
+    }
+};
+
+// Deterministic test pattern: smooth gradients, a grid of hard-edged blocks the seams have to route around, and
+// hashed noise so that the energy map has no large flat regions.
+std::vector<unsigned char> synthetic_image(uint width, uint height, uint seed = 1u)
+{
+    std::vector<unsigned char> image(static_cast<size_t>(width) * height * 4u);
+#pragma omp parallel for
+    for (int64_t y = 0; y < static_cast<int64_t>(height); ++y)
+    {
+        for (uint x = 0u; x < width; ++x)
+        {
+            uint h = (x * 73856093u) ^ (static_cast<uint>(y) * 19349663u) ^ (seed * 83492791u);
+            h ^= h >> 13u;
+            h *= 0x5bd1e995u;
+            h ^= h >> 15u;
+            const float fx = static_cast<float>(x) / static_cast<float>(width);
+            const float fy = static_cast<float>(y) / static_cast<float>(height);
+            float r = 128.0f + 100.0f * std::sin(18.85f * fx + 3.0f * fy);
+            float g = 255.0f * fy;
+            float b = 64.0f + static_cast<float>(h & 63u);
+            if ((x / std::max(width / 16u, 1u) + static_cast<uint>(y) / std::max(height / 16u, 1u)) % 7u == 0u)
+            {
+                r = 250.0f;
+                g = 20.0f;
+                b = 200.0f;
+            }
+            auto *pixel = image.data() + (static_cast<size_t>(y) * width + x) * 4u;
+            pixel[0] = static_cast<unsigned char>(r);
+            pixel[1] = static_cast<unsigned char>(g);
+            pixel[2] = static_cast<unsigned char>(b);
+            pixel[3] = 255u;
+        }
+    }
+    return image;
+}
+
+// Host-side invariants checked before any timing. A vertical seam closed in a view into a wider image must leave
+// the parent's pixels right of the view alone, and a tight view must stay tight.
+void write_results(const std::string &path, const std::string &backend, const std::vector<BenchResult> &results)
+{
+    std::ofstream file(path);
+    file << "{\n  \"backend\": \"" << backend << "\",\n  \"results\": [\n";
+    for (size_t i = 0u; i < results.size(); ++i)
+    {
+        const auto &r = results[i];
+        file << "    {\"name\": \"" << r.name << "\", \"median_ms\": " << r.median_ms << ", \"min_ms\": " << r.min_ms
+             << ", \"reps\": " << r.reps << "}" << (i + 1u < results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+}
+
+// Reads the name -> median_ms pairs of a file written by write_results, which puts every result on a line of its
+// own. Each such line is read as a flat object, so the order of its keys does not matter; other lines are skipped.
+std::map<std::string, double> read_baseline(const std::string &path)
+{
+    std::ifstream file(path);
+    LUISA_ASSERT(file, "Cannot open baseline {}.", path);
+    std::map<std::string, double> baseline;
+    for (std::string line; std::getline(file, line);)
+    {
+        std::string name;
+        double median_ms = -1.0;
+        // "key": value pairs; string values hold no quotes, since case names never do.
+        for (size_t key = line.find('"'); key != std::string::npos; key = line.find('"', key))
+        {
+            const size_t key_end = line.find('"', key + 1u);
+            const size_t colon = key_end == std::string::npos ? key_end : line.find_first_not_of(" \t", key_end + 1u);
+            if (colon == std::string::npos || line[colon] != ':')
+                break;
+            const auto field = line.substr(key + 1u, key_end - key - 1u);
+            size_t value = line.find_first_not_of(" \t", colon + 1u);
+            if (value == std::string::npos)
+                break;
+            size_t value_end;
+            if (line[value] == '"')
+            {
+                value_end = line.find('"', value + 1u);
+                if (value_end == std::string::npos)
+                    break;
+                if (field == "name")
+                    name = line.substr(value + 1u, value_end - value - 1u);
+                ++value_end;
+            }
+            else
+            {
+                value_end = line.find_first_of(",}", value);
+                if (field == "median_ms")
+                    median_ms = std::strtod(line.c_str() + value, nullptr);
+            }
+            key = value_end;
+        }
+        if (!name.empty() && median_ms >= 0.0)
+            baseline[name] = median_ms;
+    }
+    return baseline;
+}
+
+// Returns the number of regressions, counting a baseline that matches no case as one: it gates nothing.
+uint compare_with_baseline(const std::vector<BenchResult> &results, const std::map<std::string, double> &baseline, double tolerance)
+{
+    uint regressions = 0u;
+    uint missing = 0u;
+    std::cout << "\nAgainst baseline (tolerance " << tolerance * 100.0 << "%):\n";
+    for (const auto &r : results)
+    {
+        auto iter = baseline.find(r.name);
+        if (iter == baseline.end())
+        {
+            ++missing;
+            continue;
+        }
+        const double ratio = r.median_ms / iter->second;
+        const bool regressed = ratio > 1.0 + tolerance;
+        regressions += regressed ? 1u : 0u;
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << iter->second << " -> " << std::setw(10) << r.median_ms << " ms  x" << std::setprecision(2) << ratio
+                  << (regressed ? "  REGRESSION" : "") << "\n"
+                  << std::defaultfloat;
+    }
+    if (missing > 0u)
+        std::cout << missing << " case(s) not in the baseline.\n";
+    if (missing == results.size())
+    {
+        std::cout << "The baseline matches none of the cases run.\n";
+        return std::max(regressions, 1u);
+    }
+    return regressions;
+}
+
+template <SeamOrientation _O>
+const char *orientation_name() { return _O == SeamOrientation::VERTICAL ? "v" : "h"; }
+
+template <SeamOrientation _O>
+void bench_seam_carving(Bench &bench, SeamCarving &sc, const std::vector<unsigned char> &image, uint width, uint height, const std::string &resolution)
+{
+    const std::string o = orientation_name<_O>();
+    {
+        SeamCarving::Session session(sc, image.data(), width, height);
+        session.compute_cost<_O>();
+        sc.stream << synchronize();
+        bench.run(luisa::format("sc/cost/{}/{}", o, resolution).c_str(), [&]
+                  {
+            session.compute_cost<_O>();
+            sc.stream << synchronize(); });
+    }
+    for (uint seams : {1u, 16u})
+    {
+        std::unique_ptr<SeamCarving::Session> session;
+        bench.run(
+            luisa::format("sc/seams/{}/{}/s{}", o, resolution, seams).c_str(),
+            [&]
+            { session = std::make_unique<SeamCarving::Session>(sc, image.data(), width, height); },
+            [&]
+            {
+                for (uint i = 0u; i < seams; ++i)
+                    session->delete_seam<_O>();
+            });
+
+        std::unique_ptr<HostSeamCarving> host;
+        bench.run(
+            luisa::format("host/seams/{}/{}/s{}", o, resolution, seams).c_str(),
+            [&]
+            { host = std::make_unique<HostSeamCarving>(image.data(), width, height); },
+            [&]
+            {
+                for (uint i = 0u; i < seams; ++i)
+                    host->delete_seam<_O>();
+            });
+    }
+    std::unique_ptr<SeamCarving::Session> session;
+    bench.run(
+        luisa::format("sc/batch/{}/{}/k16", o, resolution).c_str(),
+        [&]
+        { session = std::make_unique<SeamCarving::Session>(sc, image.data(), width, height); },
+        [&]
+        { session->delete_seams<_O>(16u); });
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    std::string filter;
+    std::string output_path = "lct_bench.json";
+    std::string baseline_path;
+    double tolerance = 0.15;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+            quick = true;
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--out" && i + 1 < argc)
+            output_path = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = std::stod(argv[++i]);
+    }
+
+    Context context(argv[0]);
+    SeamCarving sc(context, false, "cpu");
+    auto &device = sc.device;
+    auto &stream = sc.stream;
+    lct::ShaderCache cache(context, device, "bench");
+    auto grayscale_shader = cache.compile(lct::make_grayscale_kernel(), "pixel_level_process");
+    auto sampling_shader = cache.compile(lct::make_sampling_kernel(), "image_sampling");
+    lct::ImageOpGraph grayscale_graph;
+    grayscale_graph.then(lct::ImageOp::luminance());
+    lct::ImageOpGraph tone_map_graph;
+    tone_map_graph.then(lct::ImageOp::tone_map(2.0f)).then(lct::ImageOp::luminance());
+    lct::ImageOpShaders image_ops(device, cache);
+    image_ops.prepare(grayscale_graph);
+    image_ops.prepare(tone_map_graph);
+    cache.report();
+    const auto backend = std::string(device.backend_name());
+    std::cout << "Benchmarking on the " << backend << " backend.\n";
+
+    Bench bench(filter);
+    std::vector<uint2> resolutions = {make_uint2(512u), make_uint2(1024u), make_uint2(2048u), make_uint2(3840u, 2160u), make_uint2(7680u, 4320u)};
+    if (quick)
+        resolutions.resize(3u);
+    for (auto size : resolutions)
+    {
+        const uint width = size.x;
+        const uint height = size.y;
+        const auto resolution = std::string(luisa::format("{}x{}", width, height));
+        std::vector<unsigned char> image;
+        bench.run("synthetic/" + resolution, [&]
+                  { image = synthetic_image(width, height); });
+
+        std::vector<unsigned char> png;
+        bench.run("png/encode/" + resolution, [&]
+                  {
+            png.clear();
+            lodepng::encode(png, image, width, height); });
+        std::vector<unsigned char> decoded;
+        bench.run("png/decode/" + resolution, [&]
+                  {
+            decoded.clear();
+            uint w, h;
+            lodepng::decode(decoded, w, h, png); });
+
+        // The other formats of imageio.h. Decoding goes through files, so it includes mapping them.
+        std::vector<unsigned char> encoded;
+        bench.run("png-fast/encode/" + resolution, [&]
+                  { lct::encode_image(encoded, ".png", image.data(), width, height, {.fast_png = true}); });
+        for (std::string extension : {".png", ".qoi", ".pam"})
+        {
+            const auto format = extension.substr(1u);
+            if (extension != ".png")
+                bench.run(format + "/encode/" + resolution, [&]
+                          { lct::encode_image(encoded, extension, image.data(), width, height); });
+            const auto path = (std::filesystem::temp_directory_path() / ("lct-bench" + extension)).string();
+            lct::write_image(path, image, width, height, {.fast_png = true});
+            bench.run(format + "/read/" + resolution, [&]
+                      {
+                lct::ImageFile file;
+                lct::read_image(path, file); });
+            std::filesystem::remove(path);
+        }
+
+        {
+            Image<float> texture = device.create_image<float>(PixelStorage::BYTE4, width, height, 0u);
+            Image<float> half = device.create_image<float>(PixelStorage::BYTE4, std::max(width / 2u, 1u), std::max(height / 2u, 1u), 0u);
+            Image<float> window = device.create_image<float>(PixelStorage::BYTE4, 400u, 400u, 0u);
+            BindlessArray bindless = device.create_bindless_array(1u);
+            bindless.emplace_on_update(0u, texture, Sampler(Sampler::Filter::LINEAR_LINEAR, Sampler::Address::REPEAT));
+            stream << bindless.update() << synchronize();
+            bench.run(
+                "st/grayscale/" + resolution,
+                [&]
+                { stream << texture.copy_from(image.data()) << synchronize(); },
+                [&]
+                { stream << grayscale_shader(texture).dispatch(width, height) << synchronize(); });
+            bench.run("st/resample/" + resolution + "->400x400", [&]
+                      { stream << sampling_shader(bindless, window).dispatch(400u, 400u) << synchronize(); });
+            bench.run("st/resample/" + resolution + "->half", [&]
+                      { stream << sampling_shader(bindless, half).dispatch(half.size()) << synchronize(); });
+            for (auto graph : {&grayscale_graph, &tone_map_graph})
+                bench.run("st/fused/" + graph->signature() + "/" + resolution + "->400x400", [&]
+                          {
+                CommandList cmds;
+                image_ops.record(cmds, *graph, bindless, window);
+                stream << cmds.commit() << synchronize(); });
+        }
+
+        {
+            SeamCarving::Session session(sc, image.data(), width, height);
+            bench.run("sc/energy/" + resolution, [&]
+                      { stream << sc.compute_energy(session.pixels[session.front], session.image_energy[session.energy_front], width, height, 0u, 0u, height) << synchronize(); });
+        }
+        bench_seam_carving<SeamOrientation::VERTICAL>(bench, sc, image, width, height, resolution);
+        bench_seam_carving<SeamOrientation::HORIZONTAL>(bench, sc, image, width, height, resolution);
+    }
+
+    write_results(output_path, backend, bench.results);
+    std::cout << bench.results.size() << " results written to " << output_path << ".\n";
+    if (!baseline_path.empty())
+    {
+        auto regressions = compare_with_baseline(bench.results, read_baseline(baseline_path), tolerance);
+        std::cout << regressions << " regression(s).\n";
+        return regressions == 0u ? 0 : 1;
+    }
+    return 0;
+}
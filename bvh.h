@@ -0,0 +1,744 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace lct
+{
+    constexpr uint32_t bvh_miss = ~0u;
+
+    // Triangle in the form the Moller-Trumbore test wants. `prim` is the index of the triangle in the input order.
+    struct BvhTriangle
+    {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+        uint32_t prim;
+    };
+
+    struct BvhRay
+    {
+        float origin[3];
+        float tmin;
+        float direction[3];
+        float tmax;
+    };
+
+    struct BvhHit
+    {
+        float t;
+        float u;
+        float v;
+        uint32_t prim;
+    };
+
+    // Four children per node with their bounds stored as SoA rows, so one ray tests all four boxes with 4-wide
+    // vectors. A child with count 0 is an inner node, otherwise a leaf of `count` triangles starting at `child`.
+    // Unused slots have inverted bounds and are never entered.
+    struct alignas(32) BvhNode
+    {
+        float bounds[6][4];
+        uint32_t child[4];
+        uint32_t count[4];
+    };
+    static_assert(sizeof(BvhNode) == 128u);
+
+    namespace simd
+    {
+        struct Float4
+        {
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 v;
+            static Float4 load(const float *p) { return {_mm_load_ps(p)}; }
+            static Float4 broadcast(float f) { return {_mm_set1_ps(f)}; }
+            void store(float *p) const { _mm_store_ps(p, v); }
+            friend Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+            friend Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+            friend Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+            friend Float4 operator/(Float4 a, Float4 b) { return {_mm_div_ps(a.v, b.v)}; }
+            friend Float4 min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+            friend Float4 max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+            friend uint32_t le_mask(Float4 a, Float4 b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(a.v, b.v))); }
+            friend uint32_t lt_mask(Float4 a, Float4 b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v))); }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float32x4_t v;
+            static Float4 load(const float *p) { return {vld1q_f32(p)}; }
+            static Float4 broadcast(float f) { return {vdupq_n_f32(f)}; }
+            void store(float *p) const { vst1q_f32(p, v); }
+            friend Float4 operator+(Float4 a, Float4 b) { return {vaddq_f32(a.v, b.v)}; }
+            friend Float4 operator-(Float4 a, Float4 b) { return {vsubq_f32(a.v, b.v)}; }
+            friend Float4 operator*(Float4 a, Float4 b) { return {vmulq_f32(a.v, b.v)}; }
+            friend Float4 operator/(Float4 a, Float4 b) { return {vdivq_f32(a.v, b.v)}; }
+            friend Float4 min(Float4 a, Float4 b) { return {vminq_f32(a.v, b.v)}; }
+            friend Float4 max(Float4 a, Float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+            static uint32_t bits(uint32x4_t m)
+            {
+                const uint32x4_t weights = {1u, 2u, 4u, 8u};
+                return vaddvq_u32(vandq_u32(m, weights));
+            }
+            friend uint32_t le_mask(Float4 a, Float4 b) { return bits(vcleq_f32(a.v, b.v)); }
+            friend uint32_t lt_mask(Float4 a, Float4 b) { return bits(vcltq_f32(a.v, b.v)); }
+#else
+            float v[4];
+            static Float4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+            static Float4 broadcast(float f) { return {{f, f, f, f}}; }
+            void store(float *p) const { std::copy(v, v + 4, p); }
+            template <typename F>
+            static Float4 map(Float4 a, Float4 b, F f) { return {{f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3])}}; }
+            friend Float4 operator+(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+            friend Float4 operator-(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+            friend Float4 operator*(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+            friend Float4 operator/(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x / y; }); }
+            friend Float4 min(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+            friend Float4 max(Float4 a, Float4 b) { return map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+            friend uint32_t le_mask(Float4 a, Float4 b)
+            {
+                uint32_t m = 0u;
+                for (uint32_t k = 0u; k < 4u; ++k)
+                    m |= (a.v[k] <= b.v[k] ? 1u : 0u) << k;
+                return m;
+            }
+            friend uint32_t lt_mask(Float4 a, Float4 b)
+            {
+                uint32_t m = 0u;
+                for (uint32_t k = 0u; k < 4u; ++k)
+                    m |= (a.v[k] < b.v[k] ? 1u : 0u) << k;
+                return m;
+            }
+#endif
+        };
+
+        struct Float8
+        {
+#if defined(__AVX2__)
+            __m256 v;
+            static Float8 load(const float *p) { return {_mm256_load_ps(p)}; }
+            static Float8 broadcast(float f) { return {_mm256_set1_ps(f)}; }
+            void store(float *p) const { _mm256_store_ps(p, v); }
+            friend Float8 operator+(Float8 a, Float8 b) { return {_mm256_add_ps(a.v, b.v)}; }
+            friend Float8 operator-(Float8 a, Float8 b) { return {_mm256_sub_ps(a.v, b.v)}; }
+            friend Float8 operator*(Float8 a, Float8 b) { return {_mm256_mul_ps(a.v, b.v)}; }
+            friend Float8 operator/(Float8 a, Float8 b) { return {_mm256_div_ps(a.v, b.v)}; }
+            friend Float8 min(Float8 a, Float8 b) { return {_mm256_min_ps(a.v, b.v)}; }
+            friend Float8 max(Float8 a, Float8 b) { return {_mm256_max_ps(a.v, b.v)}; }
+            friend uint32_t le_mask(Float8 a, Float8 b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ))); }
+            friend uint32_t lt_mask(Float8 a, Float8 b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))); }
+#else
+            // Two 4-wide halves: SSE or NEON without AVX2.
+            Float4 lo, hi;
+            static Float8 load(const float *p) { return {Float4::load(p), Float4::load(p + 4)}; }
+            static Float8 broadcast(float f) { return {Float4::broadcast(f), Float4::broadcast(f)}; }
+            void store(float *p) const
+            {
+                lo.store(p);
+                hi.store(p + 4);
+            }
+            friend Float8 operator+(Float8 a, Float8 b) { return {a.lo + b.lo, a.hi + b.hi}; }
+            friend Float8 operator-(Float8 a, Float8 b) { return {a.lo - b.lo, a.hi - b.hi}; }
+            friend Float8 operator*(Float8 a, Float8 b) { return {a.lo * b.lo, a.hi * b.hi}; }
+            friend Float8 operator/(Float8 a, Float8 b) { return {a.lo / b.lo, a.hi / b.hi}; }
+            friend Float8 min(Float8 a, Float8 b) { return {min(a.lo, b.lo), min(a.hi, b.hi)}; }
+            friend Float8 max(Float8 a, Float8 b) { return {max(a.lo, b.lo), max(a.hi, b.hi)}; }
+            friend uint32_t le_mask(Float8 a, Float8 b) { return le_mask(a.lo, b.lo) | le_mask(a.hi, b.hi) << 4u; }
+            friend uint32_t lt_mask(Float8 a, Float8 b) { return lt_mask(a.lo, b.lo) | lt_mask(a.hi, b.hi) << 4u; }
+#endif
+        };
+    }
+
+    // Moller-Trumbore. The packet traversal evaluates the same expressions in the same order, so both paths agree.
+    inline bool intersect_triangle(const BvhTriangle &tri, const float o[3], const float d[3], float tmin, float tmax, BvhHit &hit) noexcept
+    {
+        const float px = d[1] * tri.e2[2] - d[2] * tri.e2[1];
+        const float py = d[2] * tri.e2[0] - d[0] * tri.e2[2];
+        const float pz = d[0] * tri.e2[1] - d[1] * tri.e2[0];
+        const float det = tri.e1[0] * px + tri.e1[1] * py + tri.e1[2] * pz;
+        const float inv = 1.0f / det;
+        const float tx = o[0] - tri.v0[0];
+        const float ty = o[1] - tri.v0[1];
+        const float tz = o[2] - tri.v0[2];
+        const float u = (tx * px + ty * py + tz * pz) * inv;
+        if (!(u >= 0.0f) || u > 1.0f)
+            return false;
+        const float qx = ty * tri.e1[2] - tz * tri.e1[1];
+        const float qy = tz * tri.e1[0] - tx * tri.e1[2];
+        const float qz = tx * tri.e1[1] - ty * tri.e1[0];
+        const float v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv;
+        const float t = (tri.e2[0] * qx + tri.e2[1] * qy + tri.e2[2] * qz) * inv;
+        if (!(v >= 0.0f && u + v <= 1.0f && tmin <= t && t < tmax))
+            return false;
+        hit = {t, u, v, tri.prim};
+        return true;
+    }
+
+    // 4-wide BVH built with binned SAH.
+    // - Every node opens its largest splittable child until it has four children, so each SAH split becomes one
+    //   level of a binary tree and four binary levels collapse into two 4-wide ones.
+    // - The top of the tree is built with the binning of each split spread over all threads; once a subtree is small
+    //   enough, the remaining subtrees are built in parallel, one per thread.
+    // - Triangles are reordered so every leaf is a contiguous run.
+    class Bvh
+    {
+    public:
+        static constexpr uint32_t bin_count = 16u;
+        static constexpr uint32_t max_leaf_size = 8u;
+        static constexpr uint32_t max_depth = 64u;
+
+    private:
+        struct Aabb
+        {
+            float lo[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+            float hi[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+            void grow(const Aabb &b) noexcept
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    lo[k] = std::min(lo[k], b.lo[k]);
+                    hi[k] = std::max(hi[k], b.hi[k]);
+                }
+            }
+            void grow(const float p[3]) noexcept
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    lo[k] = std::min(lo[k], p[k]);
+                    hi[k] = std::max(hi[k], p[k]);
+                }
+            }
+            [[nodiscard]] float area() const noexcept
+            {
+                const float x = hi[0] - lo[0], y = hi[1] - lo[1], z = hi[2] - lo[2];
+                return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+            }
+        };
+
+        // Build-time copy of a triangle's bounds. Splits partition these directly, so every pass over a range streams
+        // through contiguous memory.
+        struct Reference
+        {
+            Aabb box;
+            float centroid[3];
+            uint32_t index;
+        };
+
+        struct Bin
+        {
+            Aabb bounds;
+            uint32_t count = 0u;
+        };
+
+        struct Range
+        {
+            uint32_t begin;
+            uint32_t end;
+            Aabb bounds;
+        };
+
+        struct Split
+        {
+            Range left;
+            Range right;
+        };
+
+        // An inner node still to be built from its first split.
+        struct Pending
+        {
+            uint32_t node;
+            uint32_t depth;
+            Split split;
+        };
+
+        std::vector<BvhNode> _nodes;
+        std::vector<BvhTriangle> _triangles;
+        std::vector<Reference> _references;
+        std::atomic<uint32_t> _node_count{0u};
+        Aabb _bounds;
+
+        uint32_t allocate_node() noexcept
+        {
+            const auto index = _node_count.fetch_add(1u);
+            auto &node = _nodes[index];
+            for (int r = 0; r < 6; ++r)
+                std::fill(node.bounds[r], node.bounds[r] + 4, r % 2 == 0 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity());
+            std::fill(node.child, node.child + 4, bvh_miss);
+            std::fill(node.count, node.count + 4, 0u);
+            return index;
+        }
+
+        template <typename F>
+        static void for_each_chunk(uint32_t chunks, bool parallel, F &&f)
+        {
+            if (!parallel)
+            {
+                for (uint32_t c = 0u; c < chunks; ++c)
+                    f(c);
+                return;
+            }
+#pragma omp parallel for
+            for (int64_t c = 0; c < static_cast<int64_t>(chunks); ++c)
+                f(static_cast<uint32_t>(c));
+        }
+
+        [[nodiscard]] static uint32_t bin_of(float c, float lo, float scale) noexcept
+        {
+            return std::min(bin_count - 1u, static_cast<uint32_t>(std::max((c - lo) * scale, 0.0f)));
+        }
+
+        // Binned SAH split of `range`, or nullopt when it should stay a leaf. `parallel` spreads the passes over the
+        // range across threads in fixed chunks, so the result does not depend on the thread count.
+        std::optional<Split> find_split(const Range &range, bool parallel)
+        {
+            const uint32_t count = range.end - range.begin;
+            if (count <= 1u)
+                return std::nullopt;
+            const uint32_t chunks = parallel ? 64u : 1u;
+            const uint32_t chunk_size = (count + chunks - 1u) / chunks;
+
+            // Serial splits, the vast majority, keep their per-chunk state on the stack.
+            std::vector<Aabb> chunk_centroid_storage(parallel ? chunks : 0u);
+            Aabb serial_centroids;
+            Aabb *chunk_centroids = parallel ? chunk_centroid_storage.data() : &serial_centroids;
+            for_each_chunk(chunks, parallel, [&](uint32_t c)
+                           {
+                const auto end = std::min(range.end, range.begin + (c + 1u) * chunk_size);
+                for (auto i = range.begin + c * chunk_size; i < end; ++i)
+                    chunk_centroids[c].grow(_references[i].centroid); });
+            Aabb centroid_bounds;
+            for (uint32_t c = 0u; c < chunks; ++c)
+                centroid_bounds.grow(chunk_centroids[c]);
+
+            float scale[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const float extent = centroid_bounds.hi[k] - centroid_bounds.lo[k];
+                scale[k] = extent > 0.0f ? static_cast<float>(bin_count) / extent : 0.0f;
+            }
+            std::vector<Bin> chunk_bin_storage(parallel ? static_cast<size_t>(chunks) * 3u * bin_count : 0u);
+            Bin serial_bins[3u * bin_count];
+            Bin *chunk_bins = parallel ? chunk_bin_storage.data() : serial_bins;
+            for_each_chunk(chunks, parallel, [&](uint32_t c)
+                           {
+                Bin *bins = chunk_bins + static_cast<size_t>(c) * 3u * bin_count;
+                const auto end = std::min(range.end, range.begin + (c + 1u) * chunk_size);
+                for (auto i = range.begin + c * chunk_size; i < end; ++i)
+                {
+                    const auto &reference = _references[i];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        auto &bin = bins[k * bin_count + bin_of(reference.centroid[k], centroid_bounds.lo[k], scale[k])];
+                        bin.bounds.grow(reference.box);
+                        ++bin.count;
+                    }
+                } });
+
+            float best_cost = std::numeric_limits<float>::infinity();
+            int best_axis = -1;
+            uint32_t best_bin = 0u;
+            Aabb best_left, best_right;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (scale[k] == 0.0f)
+                    continue;
+                Bin bins[bin_count];
+                for (uint32_t c = 0u; c < chunks; ++c)
+                {
+                    for (uint32_t b = 0u; b < bin_count; ++b)
+                    {
+                        const auto &src = chunk_bins[(static_cast<size_t>(c) * 3u + k) * bin_count + b];
+                        bins[b].bounds.grow(src.bounds);
+                        bins[b].count += src.count;
+                    }
+                }
+                Aabb right[bin_count];
+                uint32_t right_count[bin_count];
+                uint32_t n = 0u;
+                for (uint32_t b = bin_count - 1u; b > 0u; --b)
+                {
+                    right[b] = b + 1u < bin_count ? right[b + 1u] : Aabb{};
+                    right[b].grow(bins[b].bounds);
+                    n += bins[b].count;
+                    right_count[b] = n;
+                }
+                Aabb left;
+                n = 0u;
+                for (uint32_t b = 0u; b + 1u < bin_count; ++b)
+                {
+                    left.grow(bins[b].bounds);
+                    n += bins[b].count;
+                    if (n == 0u || right_count[b + 1u] == 0u)
+                        continue;
+                    const float cost = left.area() * static_cast<float>(n) + right[b + 1u].area() * static_cast<float>(right_count[b + 1u]);
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = k;
+                        best_bin = b;
+                        best_left = left;
+                        best_right = right[b + 1u];
+                    }
+                }
+            }
+
+            // Traversal and intersection cost the same: a leaf costs its triangle count.
+            const float area = range.bounds.area();
+            const bool fits_leaf = count <= max_leaf_size;
+            if (fits_leaf && (best_axis < 0 || area <= 0.0f || 1.0f + best_cost / area >= static_cast<float>(count)))
+                return std::nullopt;
+
+            if (best_axis >= 0)
+            {
+                const float lo = centroid_bounds.lo[best_axis];
+                const float s = scale[best_axis];
+                const auto mid = static_cast<uint32_t>(std::partition(_references.begin() + range.begin, _references.begin() + range.end, [&](const Reference &r)
+                                                                      { return bin_of(r.centroid[best_axis], lo, s) <= best_bin; }) -
+                                                       _references.begin());
+                return Split{{range.begin, mid, best_left}, {mid, range.end, best_right}};
+            }
+
+            // All centroids coincide.
+            const uint32_t mid = range.begin + count / 2u;
+            Split split{{range.begin, mid, {}}, {mid, range.end, {}}};
+            for (auto i = range.begin; i < mid; ++i)
+                split.left.bounds.grow(_references[i].box);
+            for (auto i = mid; i < range.end; ++i)
+                split.right.bounds.grow(_references[i].box);
+            return split;
+        }
+
+        // Fills `node` from `split`. Inner children go to `deferred` when given, otherwise they are built right away.
+        void build_node(const Pending &pending, std::vector<Pending> *deferred)
+        {
+            struct Child
+            {
+                Range range;
+                std::optional<Split> split;
+                bool tried;
+            };
+            Child children[4] = {{pending.split.left, std::nullopt, false}, {pending.split.right, std::nullopt, false}};
+            uint32_t child_count = 2u;
+            const bool parallel = deferred != nullptr;
+            const bool at_limit = pending.depth + 1u >= max_depth;
+            auto try_split = [&](Child &c)
+            {
+                if (!c.tried)
+                    c.split = at_limit ? std::nullopt : find_split(c.range, parallel);
+                c.tried = true;
+            };
+            while (child_count < 4u)
+            {
+                int largest = -1;
+                for (uint32_t i = 0u; i < child_count; ++i)
+                {
+                    if (children[i].tried && !children[i].split)
+                        continue;
+                    if (largest < 0 || children[i].range.bounds.area() > children[largest].range.bounds.area())
+                        largest = static_cast<int>(i);
+                }
+                if (largest < 0)
+                    break;
+                auto &c = children[largest];
+                try_split(c);
+                if (!c.split)
+                    continue;
+                const auto split = *c.split;
+                c = {split.left, std::nullopt, false};
+                children[child_count++] = {split.right, std::nullopt, false};
+            }
+
+            auto &node = _nodes[pending.node];
+            for (uint32_t i = 0u; i < child_count; ++i)
+            {
+                auto &c = children[i];
+                try_split(c);
+                for (int k = 0; k < 3; ++k)
+                {
+                    node.bounds[2 * k][i] = c.range.bounds.lo[k];
+                    node.bounds[2 * k + 1][i] = c.range.bounds.hi[k];
+                }
+                if (!c.split)
+                {
+                    node.child[i] = c.range.begin;
+                    node.count[i] = c.range.end - c.range.begin;
+                    continue;
+                }
+                Pending next{allocate_node(), pending.depth + 1u, *c.split};
+                node.child[i] = next.node;
+                if (deferred != nullptr)
+                    deferred->push_back(next);
+                else
+                    build_node(next, nullptr);
+            }
+        }
+
+    public:
+        explicit Bvh(std::vector<BvhTriangle> triangles)
+        {
+            const auto count = static_cast<uint32_t>(triangles.size());
+            _references.resize(count);
+#pragma omp parallel for
+            for (int64_t i = 0; i < static_cast<int64_t>(count); ++i)
+            {
+                const auto &tri = triangles[i];
+                Aabb box;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const float a = tri.v0[k], b = tri.v0[k] + tri.e1[k], c = tri.v0[k] + tri.e2[k];
+                    box.lo[k] = std::min({a, b, c});
+                    box.hi[k] = std::max({a, b, c});
+                    _references[i].centroid[k] = 0.5f * (box.lo[k] + box.hi[k]);
+                }
+                _references[i].box = box;
+                _references[i].index = static_cast<uint32_t>(i);
+            }
+            Range root{0u, count, {}};
+            for (const auto &reference : _references)
+                root.bounds.grow(reference.box);
+            _bounds = root.bounds;
+
+            // Inner nodes have at least two children and leaves at least one triangle.
+            _nodes.resize(std::max(count, 1u));
+            const auto root_node = allocate_node();
+            if (auto split = find_split(root, true))
+            {
+                int threads = 1;
+#ifdef _OPENMP
+                threads = omp_get_max_threads();
+#endif
+                const uint32_t threshold = std::max(4096u, count / (8u * static_cast<uint32_t>(threads)));
+                std::vector<Pending> queue{{root_node, 0u, *split}};
+                std::vector<Pending> subtrees;
+                while (!queue.empty())
+                {
+                    const auto pending = queue.back();
+                    queue.pop_back();
+                    if (pending.split.right.end - pending.split.left.begin > threshold)
+                        build_node(pending, &queue);
+                    else
+                        subtrees.push_back(pending);
+                }
+#pragma omp parallel for schedule(dynamic, 1)
+                for (int64_t i = 0; i < static_cast<int64_t>(subtrees.size()); ++i)
+                    build_node(subtrees[i], nullptr);
+            }
+            else if (count > 0u)
+            {
+                auto &node = _nodes[root_node];
+                for (int k = 0; k < 3; ++k)
+                {
+                    node.bounds[2 * k][0] = root.bounds.lo[k];
+                    node.bounds[2 * k + 1][0] = root.bounds.hi[k];
+                }
+                node.child[0] = 0u;
+                node.count[0] = count;
+            }
+            _nodes.resize(_node_count.load());
+            _nodes.shrink_to_fit();
+
+            _triangles.resize(count);
+#pragma omp parallel for
+            for (int64_t i = 0; i < static_cast<int64_t>(count); ++i)
+                _triangles[i] = triangles[_references[i].index];
+            _references = {};
+        }
+
+        [[nodiscard]] const std::vector<BvhNode> &nodes() const noexcept { return _nodes; }
+        // In leaf order; BvhTriangle::prim gives the input index.
+        [[nodiscard]] const std::vector<BvhTriangle> &triangles() const noexcept { return _triangles; }
+        [[nodiscard]] const float *bounds_min() const noexcept { return _bounds.lo; }
+        [[nodiscard]] const float *bounds_max() const noexcept { return _bounds.hi; }
+
+        // Closest hit along `ray`, or with any_hit the first hit found. prim is bvh_miss when nothing is hit.
+        template <bool any_hit = false>
+        [[nodiscard]] BvhHit intersect(const BvhRay &ray) const noexcept
+        {
+            using simd::Float4;
+            BvhHit hit{ray.tmax, 0.0f, 0.0f, bvh_miss};
+            float inv[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const float d = ray.direction[k];
+                inv[k] = 1.0f / (std::abs(d) > 1e-30f ? d : std::copysign(1e-30f, d));
+            }
+            // Rows of the near and far planes for the ray octant.
+            const int nx = inv[0] < 0.0f ? 1 : 0, ny = inv[1] < 0.0f ? 3 : 2, nz = inv[2] < 0.0f ? 5 : 4;
+            const Float4 ox = Float4::broadcast(ray.origin[0]), oy = Float4::broadcast(ray.origin[1]), oz = Float4::broadcast(ray.origin[2]);
+            const Float4 ix = Float4::broadcast(inv[0]), iy = Float4::broadcast(inv[1]), iz = Float4::broadcast(inv[2]);
+            const Float4 tmin = Float4::broadcast(ray.tmin);
+
+            uint32_t stack[3u * max_depth + 1u];
+            uint32_t top = 0u;
+            stack[top++] = 0u;
+            while (top > 0u)
+            {
+                const auto &node = _nodes[stack[--top]];
+                const Float4 tnear = max(max((Float4::load(node.bounds[nx]) - ox) * ix, (Float4::load(node.bounds[ny]) - oy) * iy),
+                                         max((Float4::load(node.bounds[nz]) - oz) * iz, tmin));
+                const Float4 tfar = min(min((Float4::load(node.bounds[nx ^ 1]) - ox) * ix, (Float4::load(node.bounds[ny ^ 1]) - oy) * iy),
+                                        min((Float4::load(node.bounds[nz ^ 1]) - oz) * iz, Float4::broadcast(hit.t)));
+                uint32_t mask = le_mask(tnear, tfar);
+                if (mask == 0u)
+                    continue;
+                alignas(16) float distance[4];
+                tnear.store(distance);
+                uint32_t inner[4];
+                uint32_t inner_count = 0u;
+                for (; mask != 0u; mask &= mask - 1u)
+                {
+                    const auto c = static_cast<uint32_t>(std::countr_zero(mask));
+                    if (node.count[c] == 0u)
+                    {
+                        // Keep the inner children sorted far to near so the nearest is popped first.
+                        uint32_t j = inner_count++;
+                        for (; j > 0u && distance[inner[j - 1u]] < distance[c]; --j)
+                            inner[j] = inner[j - 1u];
+                        inner[j] = c;
+                        continue;
+                    }
+                    for (auto i = node.child[c]; i < node.child[c] + node.count[c]; ++i)
+                        if (intersect_triangle(_triangles[i], ray.origin, ray.direction, ray.tmin, hit.t, hit) && any_hit)
+                            return hit;
+                }
+                for (uint32_t j = 0u; j < inner_count; ++j)
+                    stack[top++] = node.child[inner[j]];
+            }
+            return hit;
+        }
+
+        [[nodiscard]] bool occluded(const BvhRay &ray) const noexcept { return intersect<true>(ray).prim != bvh_miss; }
+
+        // Closest hits of eight rays traversed together: a node is entered when any active ray hits it. Best for
+        // coherent rays such as a 4x2 pixel tile of primary rays.
+        void intersect8(const BvhRay rays[8], BvhHit hits[8]) const noexcept
+        {
+            using simd::Float8;
+            alignas(32) float soa[8][8];
+            for (int l = 0; l < 8; ++l)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    soa[k][l] = rays[l].origin[k];
+                    soa[3 + k][l] = rays[l].direction[k];
+                }
+                soa[6][l] = rays[l].tmin;
+                soa[7][l] = rays[l].tmax;
+                hits[l] = {rays[l].tmax, 0.0f, 0.0f, bvh_miss};
+            }
+            const Float8 o[3] = {Float8::load(soa[0]), Float8::load(soa[1]), Float8::load(soa[2])};
+            const Float8 d[3] = {Float8::load(soa[3]), Float8::load(soa[4]), Float8::load(soa[5])};
+            Float8 inv[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                alignas(32) float lanes[8];
+                for (int l = 0; l < 8; ++l)
+                {
+                    const float dk = rays[l].direction[k];
+                    lanes[l] = 1.0f / (std::abs(dk) > 1e-30f ? dk : std::copysign(1e-30f, dk));
+                }
+                inv[k] = Float8::load(lanes);
+            }
+            const Float8 tmin = Float8::load(soa[6]);
+            alignas(32) float closest[8];
+            std::copy(soa[7], soa[7] + 8, closest);
+            Float8 tmax = Float8::load(closest);
+            const Float8 zero = Float8::broadcast(0.0f), one = Float8::broadcast(1.0f);
+
+            uint32_t stack[3u * max_depth + 1u];
+            uint32_t top = 0u;
+            stack[top++] = 0u;
+            while (top > 0u)
+            {
+                const auto &node = _nodes[stack[--top]];
+                uint32_t inner[4];
+                float distance[4];
+                uint32_t inner_count = 0u;
+                for (uint32_t c = 0u; c < 4u; ++c)
+                {
+                    if (node.count[c] == 0u && node.child[c] == bvh_miss)
+                        continue;
+                    Float8 tnear = tmin;
+                    Float8 tfar = tmax;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const Float8 t0 = (Float8::broadcast(node.bounds[2 * k][c]) - o[k]) * inv[k];
+                        const Float8 t1 = (Float8::broadcast(node.bounds[2 * k + 1][c]) - o[k]) * inv[k];
+                        tnear = max(tnear, min(t0, t1));
+                        tfar = min(tfar, max(t0, t1));
+                    }
+                    const uint32_t mask = le_mask(tnear, tfar);
+                    if (mask == 0u)
+                        continue;
+                    if (node.count[c] == 0u)
+                    {
+                        alignas(32) float lanes[8];
+                        tnear.store(lanes);
+                        float nearest = std::numeric_limits<float>::infinity();
+                        for (uint32_t m = mask; m != 0u; m &= m - 1u)
+                            nearest = std::min(nearest, lanes[std::countr_zero(m)]);
+                        uint32_t j = inner_count++;
+                        for (; j > 0u && distance[j - 1u] < nearest; --j)
+                        {
+                            inner[j] = inner[j - 1u];
+                            distance[j] = distance[j - 1u];
+                        }
+                        inner[j] = node.child[c];
+                        distance[j] = nearest;
+                        continue;
+                    }
+                    for (auto i = node.child[c]; i < node.child[c] + node.count[c]; ++i)
+                    {
+                        const auto &tri = _triangles[i];
+                        const Float8 e1x = Float8::broadcast(tri.e1[0]), e1y = Float8::broadcast(tri.e1[1]), e1z = Float8::broadcast(tri.e1[2]);
+                        const Float8 e2x = Float8::broadcast(tri.e2[0]), e2y = Float8::broadcast(tri.e2[1]), e2z = Float8::broadcast(tri.e2[2]);
+                        const Float8 px = d[1] * e2z - d[2] * e2y;
+                        const Float8 py = d[2] * e2x - d[0] * e2z;
+                        const Float8 pz = d[0] * e2y - d[1] * e2x;
+                        const Float8 det = e1x * px + e1y * py + e1z * pz;
+                        const Float8 inv_det = one / det;
+                        const Float8 tx = o[0] - Float8::broadcast(tri.v0[0]);
+                        const Float8 ty = o[1] - Float8::broadcast(tri.v0[1]);
+                        const Float8 tz = o[2] - Float8::broadcast(tri.v0[2]);
+                        const Float8 u = (tx * px + ty * py + tz * pz) * inv_det;
+                        const Float8 qx = ty * e1z - tz * e1y;
+                        const Float8 qy = tz * e1x - tx * e1z;
+                        const Float8 qz = tx * e1y - ty * e1x;
+                        const Float8 v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv_det;
+                        const Float8 t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+                        const uint32_t hit_mask = mask & le_mask(zero, u) & le_mask(zero, v) & le_mask(u + v, one) &
+                                                  le_mask(tmin, t) & lt_mask(t, tmax);
+                        if (hit_mask == 0u)
+                            continue;
+                        alignas(32) float tl[8], ul[8], vl[8];
+                        t.store(tl);
+                        u.store(ul);
+                        v.store(vl);
+                        for (uint32_t m = hit_mask; m != 0u; m &= m - 1u)
+                        {
+                            const auto l = std::countr_zero(m);
+                            closest[l] = tl[l];
+                            hits[l] = {tl[l], ul[l], vl[l], tri.prim};
+                        }
+                        tmax = Float8::load(closest);
+                    }
+                }
+                for (uint32_t j = 0u; j < inner_count; ++j)
+                    stack[top++] = inner[j];
+            }
+        }
+    };
+}
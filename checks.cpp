@@ -0,0 +1,96 @@
+#include <iostream>
+#include <imageio.h>
+#include <imageview.h>
+#include <cstdint>
+#include <filesystem>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// lct-checks runs the host-side invariants that need no device and no assets: StridedImageView seam closing and
+// image encode/decode round trips. CTest runs it with the other tests; the exit code is 1 if any check fails.
+
+bool check_strided_view()
+{
+    constexpr uint32_t parent_width = 10u, height = 4u, view_width = 5u;
+    std::vector<uint32_t> parent(parent_width * height);
+    std::iota(parent.begin(), parent.end(), 0u);
+    const auto original = parent;
+    const uint32_t seam[height] = {0u, 2u, 4u, 1u};
+    lct::StridedImageView<uint32_t> view{parent.data(), view_width, height, parent_width};
+    view.close_vertical_seam(seam);
+    bool ok = view.width == view_width - 1u && view.stride == parent_width;
+    for (uint32_t y = 0u; y < height; ++y)
+    {
+        for (uint32_t x = 0u; x < view_width - 1u; ++x)
+            ok = ok && view(x, y) == original[y * parent_width + x + (x >= seam[y] ? 1u : 0u)];
+        for (uint32_t x = view_width; x < parent_width; ++x)
+            ok = ok && parent[y * parent_width + x] == original[y * parent_width + x];
+    }
+    std::vector<uint32_t> tight(view_width * height);
+    std::iota(tight.begin(), tight.end(), 0u);
+    lct::StridedImageView<uint32_t> tight_view{tight.data(), view_width, height, view_width};
+    tight_view.close_vertical_seam(seam);
+    ok = ok && tight_view.contiguous();
+    for (uint32_t y = 0u; y < height; ++y)
+        for (uint32_t x = 0u; x < view_width - 1u; ++x)
+            ok = ok && tight[y * (view_width - 1u) + x] == y * view_width + x + (x >= seam[y] ? 1u : 0u);
+    if (!ok)
+        std::cerr << "StridedImageView::close_vertical_seam check failed.\n";
+    return ok;
+}
+
+// Flat runs, small and large steps between neighbours and varying alpha, so every QOI op and every PNG row filter
+// is exercised.
+std::vector<unsigned char> check_pattern(uint32_t width, uint32_t height)
+{
+    std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4u);
+    for (uint32_t y = 0u; y < height; ++y)
+        for (uint32_t x = 0u; x < width; ++x)
+        {
+            auto *p = rgba.data() + (static_cast<size_t>(y) * width + x) * 4u;
+            const bool flat = (x / 8u + y / 8u) % 3u == 0u;
+            p[0] = static_cast<unsigned char>(flat ? 40u : x * 3u + y);
+            p[1] = static_cast<unsigned char>(flat ? 200u : x * 37u ^ y * 11u);
+            p[2] = static_cast<unsigned char>(flat ? 90u : (x + y) % 5u);
+            p[3] = static_cast<unsigned char>(y % 4u == 3u ? x * 17u : 255u);
+        }
+    return rgba;
+}
+
+// Encodes with write_image and reads back with read_image, which must return the same pixels.
+bool check_round_trip(const std::string &extension, const lct::ImageWriteOptions &options)
+{
+    bool ok = true;
+    const auto path = (std::filesystem::temp_directory_path() / ("lct_checks" + extension)).string();
+    const uint32_t sizes[][2] = {{1u, 1u}, {7u, 3u}, {64u, 64u}, {129u, 31u}};
+    for (const auto &[width, height] : sizes)
+    {
+        const auto rgba = check_pattern(width, height);
+        lct::ImageFile image;
+        const char *error = lct::write_image(path, rgba, width, height, options);
+        if (!error)
+            error = lct::read_image(path, image);
+        const bool same = !error && image.width() == width && image.height() == height &&
+                          std::equal(rgba.begin(), rgba.end(), image.pixels());
+        if (!same)
+            std::cerr << extension << (options.fast_png ? " (fast)" : "") << " round trip of " << width << "x" << height
+                      << " failed" << (error ? std::string(": ") + error : std::string()) << ".\n";
+        ok = ok && same;
+    }
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = check_strided_view() && ok;
+    ok = check_round_trip(".qoi", {}) && ok;
+    ok = check_round_trip(".png", {.fast_png = true}) && ok;
+    ok = check_round_trip(".pam", {}) && ok;
+    if (ok)
+        std::cout << "All checks passed.\n";
+    return ok ? 0 : 1;
+}
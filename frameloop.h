@@ -0,0 +1,134 @@
+#pragma once
+
+#include <luisa-compute.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lct
+{
+    // --headless <frames> [--ring <images>] of wt and st. Windowed when frames is 0.
+    struct FrameLoopOptions
+    {
+        static constexpr const char *usage = "[--headless <frames>] [--ring <images>]";
+
+        uint32_t frames = 0u;
+        uint32_t ring = 3u;
+
+        // Consumes the flag at argv[i] and its value if it is one of ours. False for any other flag, and for ours
+        // when the value is missing or not a whole decimal number; the tools then reject the command line.
+        bool parse(int argc, char **argv, int &i)
+        {
+            std::string_view arg = argv[i];
+            uint32_t *target = arg == "--headless" ? &frames : arg == "--ring" ? &ring : nullptr;
+            if (target == nullptr || i + 1 >= argc)
+                return false;
+            std::string_view text = argv[i + 1];
+            uint32_t value = 0u;
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (error != std::errc() || end != text.data() + text.size())
+                return false;
+            *target = target == &ring ? std::max(value, 1u) : value;
+            ++i;
+            return true;
+        }
+    };
+
+    // Offscreen stand-in for a swapchain loop, for measuring frame-loop overhead on machines without a display.
+    // Frame i renders into ring slot i % ring; like a swapchain with that many back buffers, at most ring frames are
+    // in flight and the host blocks until the oldest one completes. Every frame is recorded into the same
+    // CommandList. A stream callback after each frame timestamps its completion; the frame times are the intervals
+    // between completions, i.e. what a display would see.
+    template <typename Stream>
+    class HeadlessFrameLoop
+    {
+        using clock = std::chrono::steady_clock;
+
+        Stream &_stream;
+        uint32_t _ring;
+        std::mutex _mutex;
+        std::condition_variable _completed_changed;
+        uint64_t _completed = 0u;
+        std::vector<clock::time_point> _completion_times;
+        double _record_ms = 0.0;
+        double _wall_ms = 0.0;
+
+        static double milliseconds(clock::duration d) noexcept { return std::chrono::duration<double, std::milli>(d).count(); }
+
+    public:
+        HeadlessFrameLoop(Stream &stream, uint32_t ring) : _stream(stream), _ring(std::max(ring, 1u)) {}
+
+        HeadlessFrameLoop(const HeadlessFrameLoop &) = delete;
+        HeadlessFrameLoop &operator=(const HeadlessFrameLoop &) = delete;
+
+        [[nodiscard]] uint32_t ring() const noexcept { return _ring; }
+
+        // record(commands, frame, slot) appends frame `frame`'s commands, rendering into ring slot `slot`.
+        template <typename Record>
+        void run(uint32_t frames, Record &&record)
+        {
+            _completed = 0u;
+            _completion_times.assign(frames, clock::time_point{});
+            _record_ms = 0.0;
+            luisa::compute::CommandList commands;
+            const auto begin = clock::now();
+            for (uint32_t frame = 0u; frame < frames; ++frame)
+            {
+                {
+                    std::unique_lock lock(_mutex);
+                    _completed_changed.wait(lock, [&]
+                                            { return frame - _completed < _ring; });
+                }
+                const auto record_begin = clock::now();
+                record(commands, frame, frame % _ring);
+                _stream << commands.commit() << [this, frame]
+                {
+                    const auto now = clock::now();
+                    std::lock_guard lock(_mutex);
+                    _completion_times[frame] = now;
+                    ++_completed;
+                    _completed_changed.notify_all();
+                };
+                _record_ms += milliseconds(clock::now() - record_begin);
+            }
+            _stream << luisa::compute::synchronize();
+            _wall_ms = milliseconds(clock::now() - begin);
+        }
+
+        // Frame-time percentiles, throughput and host cost per frame. The first interval is measured from the first
+        // completion, so the pipeline fill is not counted as a frame.
+        void report(std::string_view tool) const
+        {
+            const auto frames = _completion_times.size();
+            if (frames < 2u)
+                return;
+            std::vector<double> intervals;
+            intervals.reserve(frames - 1u);
+            for (size_t i = 1u; i < frames; ++i)
+                intervals.push_back(milliseconds(_completion_times[i] - _completion_times[i - 1u]));
+            std::sort(intervals.begin(), intervals.end());
+            auto percentile = [&](double p)
+            {
+                const auto rank = static_cast<size_t>(p * static_cast<double>(intervals.size()) + 0.5);
+                return intervals[std::clamp<size_t>(rank, 1u, intervals.size()) - 1u];
+            };
+            const double span_ms = milliseconds(_completion_times.back() - _completion_times.front());
+            std::cout << "[" << tool << "] " << frames << " headless frames, ring of " << _ring << ", " << std::fixed << std::setprecision(3)
+                      << "frame time p50 " << percentile(0.5) << " ms, p95 " << percentile(0.95) << " ms, p99 " << percentile(0.99)
+                      << " ms, max " << intervals.back() << " ms.\n"
+                      << "[" << tool << "] " << std::setprecision(1) << 1000.0 * static_cast<double>(frames - 1u) / span_ms << " frames/s ("
+                      << 1000.0 * static_cast<double>(frames) / _wall_ms << " including pipeline fill), " << std::setprecision(3)
+                      << _record_ms / static_cast<double>(frames) << " ms host record and submit per frame.\n"
+                      << std::defaultfloat;
+        }
+    };
+}
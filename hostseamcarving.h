@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <imageview.h>
+#include <trace.h>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+enum struct SeamOrientation
+{
+    VERTICAL,
+    HORIZONTAL
+};
+
+// Native host implementation of the seam carving pipeline (energy, cost DP, backtrace and compaction) for machines
+// without a GPU and as the oracle for SeamCarving::Session. Every stage repeats the device kernels operation for
+// operation: the same luminance and Sobel evaluation order, the same predecessor tie-breaking, the first minimum of
+// the last row, and the same incremental energy band. With the device kernels compiled without fast math, both
+// produce the same bits.
+//
+// Work happens in the frame of the current orientation: horizontal seams are carved as vertical seams of the
+// transposed image. Sobel energy is exactly transpose-invariant, so the image is only transposed when the
+// orientation changes or on download.
+class HostSeamCarving
+{
+public:
+    // Seams of a batch are accepted while their cost is at most max_cost_ratio times the larger of the first seam's
+    // cost and this floor, so that a free first seam does not reject every seam after it.
+    static constexpr float seam_cost_floor = 1.0f / 255.0f;
+
+    uint32_t width;
+    uint32_t height;
+
+    HostSeamCarving(const unsigned char *image_buffer, uint32_t width, uint32_t height)
+        : width(width), height(height)
+    {
+        _pixels.resize(static_cast<size_t>(width) * height);
+        std::memcpy(_pixels.data(), image_buffer, _pixels.size() * 4u);
+        _luminance.resize(_pixels.size());
+        _energy.resize(_pixels.size());
+        _cost.resize(_pixels.size());
+        _pred.resize(_pixels.size());
+#pragma omp parallel for
+        for (int64_t i = 0; i < static_cast<int64_t>(_pixels.size()); ++i)
+            _luminance[i] = luminance(_pixels[i]);
+    }
+
+    template <SeamOrientation _O = SeamOrientation::VERTICAL>
+    void delete_seam()
+    {
+        orient(_O == SeamOrientation::HORIZONTAL);
+        if (across() <= 1u)
+            return;
+        if (!_energy_valid)
+            compute_energy();
+        compute_cost();
+        trace();
+        remove_seam();
+    }
+
+    // Host counterpart of Session::delete_seams: up to k pixel-disjoint seams from one cost map.
+    template <SeamOrientation _O = SeamOrientation::VERTICAL>
+    uint32_t delete_seams(uint32_t k, float max_cost_ratio = std::numeric_limits<float>::infinity())
+    {
+        orient(_O == SeamOrientation::HORIZONTAL);
+        const uint32_t n = across();
+        const uint32_t m = along();
+        k = std::min(k, n - 1u);
+        if (k == 0u)
+            return 0u;
+        if (!_energy_valid)
+            compute_energy();
+        compute_cost();
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        _mask.assign(static_cast<size_t>(n) * m, 0u);
+        _seams.resize(static_cast<size_t>(k) * m);
+        auto at = [n](uint32_t i, uint32_t j)
+        { return static_cast<size_t>(j) * n + i; };
+        uint32_t found = 0u;
+        float first_cost = inf;
+        while (found < k)
+        {
+            float best = inf;
+            uint32_t start = ~0u;
+            for (uint32_t i = 0u; i < n; ++i)
+            {
+                if (_mask[at(i, m - 1u)] == 0u && _cost[at(i, m - 1u)] < best)
+                {
+                    best = _cost[at(i, m - 1u)];
+                    start = i;
+                }
+            }
+            if (start == ~0u || (found > 0u && best > std::max(first_cost, seam_cost_floor) * max_cost_ratio))
+                break;
+            if (found == 0u)
+                first_cost = best;
+            auto *seam = _seams.data() + static_cast<size_t>(found) * m;
+            uint32_t i = start;
+            bool blocked = false;
+            seam[m - 1u] = i;
+            for (uint32_t j = m - 1u; j > 0u; --j)
+            {
+                float best_cost = inf;
+                uint32_t best_index = ~0u;
+                if (_mask[at(i, j - 1u)] == 0u)
+                {
+                    best_cost = _cost[at(i, j - 1u)];
+                    best_index = i;
+                }
+                if (i > 0u && _mask[at(i - 1u, j - 1u)] == 0u && _cost[at(i - 1u, j - 1u)] < best_cost)
+                {
+                    best_cost = _cost[at(i - 1u, j - 1u)];
+                    best_index = i - 1u;
+                }
+                if (i + 1u < n && _mask[at(i + 1u, j - 1u)] == 0u && _cost[at(i + 1u, j - 1u)] < best_cost)
+                {
+                    best_cost = _cost[at(i + 1u, j - 1u)];
+                    best_index = i + 1u;
+                }
+                if (best_index == ~0u)
+                {
+                    blocked = true;
+                    break;
+                }
+                i = best_index;
+                seam[j - 1u] = i;
+            }
+            if (blocked)
+                _mask[at(start, m - 1u)] = 2u;
+            else
+            {
+                for (uint32_t j = 0u; j < m; ++j)
+                    _mask[at(seam[j], j)] = 1u;
+                ++found;
+            }
+        }
+
+        // Rows only ever move towards the front, so the compaction can run in place.
+        for (uint32_t j = 0u; j < m; ++j)
+        {
+            size_t w = static_cast<size_t>(j) * (n - found);
+            for (uint32_t i = 0u; i < n; ++i)
+            {
+                if (_mask[at(i, j)] != 1u)
+                {
+                    _pixels[w] = _pixels[at(i, j)];
+                    _luminance[w] = _luminance[at(i, j)];
+                    ++w;
+                }
+            }
+        }
+        shrink(found);
+        _energy_valid = false;
+        return found;
+    }
+
+    void download(std::vector<unsigned char> &image_buffer) const
+    {
+        image_buffer.resize(static_cast<size_t>(width) * height * 4u);
+        if (_transposed)
+            transpose(_pixels.data(), reinterpret_cast<uint32_t *>(image_buffer.data()), height, width);
+        else
+            std::memcpy(image_buffer.data(), _pixels.data(), image_buffer.size());
+    }
+
+    [[nodiscard]] const std::vector<uint32_t> &seam() const noexcept { return _seam; }
+
+    // The per-pixel stages, shared with VideoSeamCarving so both produce the same bits.
+
+    // Sobel magnitude at (i, j) of an n x m luminance plane, clamped at the border.
+    [[nodiscard]] static float sobel(const float *luminance, uint32_t n, uint32_t m, uint32_t i, uint32_t j) noexcept
+    {
+        auto l = [&](int ox, int oy)
+        {
+            const int x = std::clamp(static_cast<int>(i) + ox, 0, static_cast<int>(n) - 1);
+            const int y = std::clamp(static_cast<int>(j) + oy, 0, static_cast<int>(m) - 1);
+            return luminance[static_cast<size_t>(y) * n + x];
+        };
+        const float dx = (l(1, -1) + 2.0f * l(1, 0) + l(1, 1)) - (l(-1, -1) + 2.0f * l(-1, 0) + l(-1, 1));
+        const float dy = (l(-1, 1) + 2.0f * l(0, 1) + l(1, 1)) - (l(-1, -1) + 2.0f * l(0, -1) + l(1, -1));
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    static float luminance(uint32_t rgba) noexcept
+    {
+        const float r = static_cast<float>(rgba & 0xffu) / 255.0f;
+        const float g = static_cast<float>((rgba >> 8u) & 0xffu) / 255.0f;
+        const float b = static_cast<float>((rgba >> 16u) & 0xffu) / 255.0f;
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    // One row of the cost DP: c[i] = e[i] + min over p[i - 1], p[i], p[i + 1], preferring the straight predecessor,
+    // then the left one, exactly like the device kernels.
+    static void cost_row(const float *p, const float *e, float *c, uint8_t *pred, uint32_t n) noexcept
+    {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        auto scalar = [&](uint32_t i)
+        {
+            const float lt = i > 0u ? p[i - 1u] : inf;
+            const float rt = i + 1u < n ? p[i + 1u] : inf;
+            float best = p[i];
+            uint8_t pr = 1u;
+            if (lt < best)
+            {
+                best = lt;
+                pr = 0u;
+            }
+            if (rt < best)
+            {
+                best = rt;
+                pr = 2u;
+            }
+            c[i] = e[i] + best;
+            pred[i] = pr;
+        };
+        uint32_t i = 0u;
+        if (n > 2u)
+        {
+            scalar(0u);
+            i = 1u;
+#if defined(__AVX2__)
+            for (; i + 8u < n; i += 8u)
+            {
+                const __m256 lt = _mm256_loadu_ps(p + i - 1u);
+                const __m256 rt = _mm256_loadu_ps(p + i + 1u);
+                __m256 best = _mm256_loadu_ps(p + i);
+                const __m256 left = _mm256_cmp_ps(lt, best, _CMP_LT_OQ);
+                best = _mm256_blendv_ps(best, lt, left);
+                const __m256 right = _mm256_cmp_ps(rt, best, _CMP_LT_OQ);
+                best = _mm256_blendv_ps(best, rt, right);
+                _mm256_storeu_ps(c + i, _mm256_add_ps(_mm256_loadu_ps(e + i), best));
+                const int l = _mm256_movemask_ps(left);
+                const int r = _mm256_movemask_ps(right);
+                for (uint32_t k = 0u; k < 8u; ++k)
+                    pred[i + k] = (r >> k) & 1 ? 2u : ((l >> k) & 1 ? 0u : 1u);
+            }
+#elif defined(__SSE2__) || defined(_M_X64)
+            // Baseline x86-64: SSE2 has no blendv, so the selects are and/andnot/or.
+            for (; i + 4u < n; i += 4u)
+            {
+                const __m128 lt = _mm_loadu_ps(p + i - 1u);
+                const __m128 rt = _mm_loadu_ps(p + i + 1u);
+                __m128 best = _mm_loadu_ps(p + i);
+                const __m128 left = _mm_cmplt_ps(lt, best);
+                best = _mm_or_ps(_mm_and_ps(left, lt), _mm_andnot_ps(left, best));
+                const __m128 right = _mm_cmplt_ps(rt, best);
+                best = _mm_or_ps(_mm_and_ps(right, rt), _mm_andnot_ps(right, best));
+                _mm_storeu_ps(c + i, _mm_add_ps(_mm_loadu_ps(e + i), best));
+                const int l = _mm_movemask_ps(left);
+                const int r = _mm_movemask_ps(right);
+                for (uint32_t k = 0u; k < 4u; ++k)
+                    pred[i + k] = (r >> k) & 1 ? 2u : ((l >> k) & 1 ? 0u : 1u);
+            }
+#elif defined(__ARM_NEON)
+            for (; i + 4u < n; i += 4u)
+            {
+                const float32x4_t lt = vld1q_f32(p + i - 1u);
+                const float32x4_t rt = vld1q_f32(p + i + 1u);
+                float32x4_t best = vld1q_f32(p + i);
+                const uint32x4_t left = vcltq_f32(lt, best);
+                best = vbslq_f32(left, lt, best);
+                const uint32x4_t right = vcltq_f32(rt, best);
+                best = vbslq_f32(right, rt, best);
+                vst1q_f32(c + i, vaddq_f32(vld1q_f32(e + i), best));
+                const uint32x4_t pr = vbslq_u32(right, vdupq_n_u32(2u), vbslq_u32(left, vdupq_n_u32(0u), vdupq_n_u32(1u)));
+                const uint16x4_t pr16 = vmovn_u32(pr);
+                const uint8x8_t pr8 = vmovn_u16(vcombine_u16(pr16, pr16));
+                vst1_lane_u32(reinterpret_cast<uint32_t *>(pred + i), vreinterpret_u32_u8(pr8), 0);
+            }
+#endif
+        }
+        for (; i < n; ++i)
+            scalar(i);
+    }
+
+private:
+    bool _transposed = false;
+    bool _energy_valid = false;
+    std::vector<uint32_t> _pixels;
+    std::vector<float> _luminance;
+    std::vector<float> _energy;
+    std::vector<float> _cost;
+    std::vector<uint8_t> _pred;
+    std::vector<uint8_t> _mask;
+    std::vector<uint32_t> _seam;
+    std::vector<uint32_t> _seams;
+    std::vector<uint32_t> _pixels_scratch;
+    std::vector<float> _float_scratch;
+
+    [[nodiscard]] uint32_t across() const noexcept { return _transposed ? height : width; }
+    [[nodiscard]] uint32_t along() const noexcept { return _transposed ? width : height; }
+
+    void shrink(uint32_t count) noexcept
+    {
+        if (_transposed)
+            height -= count;
+        else
+            width -= count;
+    }
+
+    // Blocked transpose of an n x m (columns x rows) plane into an m x n one.
+    template <typename T>
+    static void transpose(const T *src, T *dst, uint32_t n, uint32_t m)
+    {
+        constexpr uint32_t block = 32u;
+#pragma omp parallel for
+        for (int64_t jb = 0; jb < static_cast<int64_t>(m); jb += block)
+            for (uint32_t ib = 0u; ib < n; ib += block)
+                for (uint32_t j = static_cast<uint32_t>(jb); j < std::min<uint32_t>(static_cast<uint32_t>(jb) + block, m); ++j)
+                    for (uint32_t i = ib; i < std::min(ib + block, n); ++i)
+                        dst[static_cast<size_t>(i) * m + j] = src[static_cast<size_t>(j) * n + i];
+    }
+
+    template <typename T>
+    static void transpose_in_place(std::vector<T> &plane, std::vector<T> &scratch, uint32_t n, uint32_t m)
+    {
+        scratch.resize(plane.size());
+        transpose(plane.data(), scratch.data(), n, m);
+        std::swap(plane, scratch);
+    }
+
+    void orient(bool transposed)
+    {
+        if (transposed == _transposed)
+            return;
+        lct::TraceScope scope("host transpose");
+        const uint32_t n = across();
+        const uint32_t m = along();
+        transpose_in_place(_pixels, _pixels_scratch, n, m);
+        transpose_in_place(_luminance, _float_scratch, n, m);
+        if (_energy_valid)
+            transpose_in_place(_energy, _float_scratch, n, m);
+        _transposed = transposed;
+    }
+
+    [[nodiscard]] float sobel(uint32_t i, uint32_t j) const noexcept { return sobel(_luminance.data(), across(), along(), i, j); }
+
+    void compute_energy()
+    {
+        lct::TraceScope scope("host energy");
+        const uint32_t n = across();
+        const uint32_t m = along();
+#pragma omp parallel for
+        for (int64_t j = 0; j < static_cast<int64_t>(m); ++j)
+            for (uint32_t i = 0u; i < n; ++i)
+                _energy[static_cast<size_t>(j) * n + i] = sobel(i, static_cast<uint32_t>(j));
+        _energy_valid = true;
+    }
+
+    void compute_cost()
+    {
+        lct::TraceScope scope("host cost");
+        const uint32_t n = across();
+        const uint32_t m = along();
+        // Row 0 is the energy itself (the device seeds it as energy + 0).
+        std::copy(_energy.begin(), _energy.begin() + n, _cost.begin());
+        for (uint32_t j = 1u; j < m; ++j)
+        {
+            const size_t row = static_cast<size_t>(j) * n;
+            cost_row(_cost.data() + row - n, _energy.data() + row, _cost.data() + row, _pred.data() + row, n);
+        }
+    }
+
+    void trace()
+    {
+        lct::TraceScope scope("host trace seam");
+        const uint32_t n = across();
+        const uint32_t m = along();
+        const float *last = _cost.data() + static_cast<size_t>(m - 1u) * n;
+        uint32_t i = static_cast<uint32_t>(std::min_element(last, last + n) - last);
+        _seam.resize(m);
+        _seam[m - 1u] = i;
+        for (uint32_t j = m - 1u; j > 0u; --j)
+        {
+            i = i + _pred[static_cast<size_t>(j) * n + i] - 1u;
+            _seam[j - 1u] = i;
+        }
+    }
+
+    template <typename T>
+    void close_seam(std::vector<T> &plane, uint32_t n, uint32_t m) const
+    {
+        lct::StridedImageView<T>{plane.data(), n, m, n}.close_vertical_seam(_seam.data());
+    }
+
+    // Closes the seam in the pixels, luminance and energy planes, then refreshes the energy band [s - 2, s + 1].
+    void remove_seam()
+    {
+        lct::TraceScope scope("host remove seam");
+        const uint32_t n = across();
+        const uint32_t m = along();
+        close_seam(_pixels, n, m);
+        close_seam(_luminance, n, m);
+        close_seam(_energy, n, m);
+        shrink(1u);
+#pragma omp parallel for
+        for (int64_t j = 0; j < static_cast<int64_t>(m); ++j)
+        {
+            const int s = static_cast<int>(_seam[j]);
+            const int begin = std::max(s - 2, 0);
+            const int end = std::min(s + 1, static_cast<int>(n) - 2);
+            for (int i = begin; i <= end; ++i)
+                _energy[static_cast<size_t>(j) * (n - 1u) + i] = sobel(static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+        }
+    }
+};
@@ -0,0 +1,606 @@
+#pragma once
+
+#include <lodepng.h>
+#include <mappedfile.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lct
+{
+    // Image files of the tools, picked by extension. Besides PNG through lodepng there are formats that are cheap to
+    // produce and read: binary netpbm (.ppm RGB, .pam RGBA), QOI, and PFM float maps for energy and cost dumps.
+    // - Input is memory mapped. RGBA8 PAM files are not decoded at all: ImageFile::pixels() points into the mapping
+    //   and can be handed to Image::copy_from directly.
+    // - With fast_png, PNGs are written with every row's filter chosen in parallel and a low-effort deflate, instead
+    //   of lodepng's default single-threaded encoder tuned for size.
+    // Errors are reported like lodepng_error_text: a static message, or nullptr on success.
+
+    struct ImageWriteOptions
+    {
+        bool fast_png = false;
+    };
+
+    // An RGBA8 image read by read_image. Owns either the decoded pixels or the mapping they live in.
+    class ImageFile
+    {
+        MappedFile _mapping;
+        std::vector<unsigned char> _storage;
+        const unsigned char *_pixels = nullptr;
+        uint32_t _width = 0u;
+        uint32_t _height = 0u;
+
+    public:
+        [[nodiscard]] uint32_t width() const noexcept { return _width; }
+        [[nodiscard]] uint32_t height() const noexcept { return _height; }
+        [[nodiscard]] const unsigned char *pixels() const noexcept { return _pixels; }
+        [[nodiscard]] size_t size_bytes() const noexcept { return static_cast<size_t>(_width) * _height * 4u; }
+        [[nodiscard]] bool mapped() const noexcept { return _pixels != nullptr && _storage.empty(); }
+
+        // Moves the decoded pixels out, copying them out of the mapping if the file was read in place.
+        [[nodiscard]] std::vector<unsigned char> take()
+        {
+            if (mapped())
+                _storage.assign(_pixels, _pixels + size_bytes());
+            _pixels = nullptr;
+            _mapping = MappedFile();
+            return std::move(_storage);
+        }
+
+        // Decoders fill in the size and either decoded pixels or an offset into the mapping.
+        void set(uint32_t width, uint32_t height, std::vector<unsigned char> pixels)
+        {
+            _width = width;
+            _height = height;
+            _storage = std::move(pixels);
+            _pixels = _storage.data();
+        }
+
+        void set_mapped(uint32_t width, uint32_t height, MappedFile mapping, size_t offset)
+        {
+            _width = width;
+            _height = height;
+            _storage.clear();
+            _mapping = std::move(mapping);
+            _pixels = _mapping.as<unsigned char>(offset);
+        }
+    };
+
+    namespace detail
+    {
+        inline std::string lowercase_extension(const std::string &path)
+        {
+            auto extension = std::filesystem::path(path).extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            return extension;
+        }
+
+        // Header tokens of netpbm files, skipping whitespace and comments. Leaves `offset` after the token.
+        inline std::string_view next_token(const unsigned char *data, size_t size, size_t &offset)
+        {
+            while (offset < size)
+            {
+                if (data[offset] == '#')
+                    while (offset < size && data[offset] != '\n')
+                        ++offset;
+                else if (std::isspace(data[offset]))
+                    ++offset;
+                else
+                    break;
+            }
+            const size_t begin = offset;
+            while (offset < size && !std::isspace(data[offset]))
+                ++offset;
+            return {reinterpret_cast<const char *>(data) + begin, offset - begin};
+        }
+
+        inline uint32_t to_uint(std::string_view token)
+        {
+            uint32_t value = 0u;
+            for (char c : token)
+            {
+                if (c < '0' || c > '9')
+                    return 0u;
+                value = value * 10u + static_cast<uint32_t>(c - '0');
+            }
+            return value;
+        }
+
+        // Expands 1 to 3 channel 8-bit samples (gray, gray + alpha, RGB) to RGBA8.
+        inline std::vector<unsigned char> expand_to_rgba(const unsigned char *samples, uint32_t width, uint32_t height, uint32_t channels)
+        {
+            std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4u);
+#pragma omp parallel for
+            for (int64_t y = 0; y < static_cast<int64_t>(height); ++y)
+            {
+                for (uint32_t x = 0u; x < width; ++x)
+                {
+                    const size_t i = static_cast<size_t>(y) * width + x;
+                    const unsigned char *s = samples + i * channels;
+                    unsigned char *d = rgba.data() + i * 4u;
+                    if (channels >= 3u)
+                    {
+                        d[0] = s[0];
+                        d[1] = s[1];
+                        d[2] = s[2];
+                        d[3] = channels == 4u ? s[3] : 255u;
+                    }
+                    else
+                    {
+                        d[0] = d[1] = d[2] = s[0];
+                        d[3] = channels == 2u ? s[1] : 255u;
+                    }
+                }
+            }
+            return rgba;
+        }
+
+        inline const char *read_netpbm(MappedFile mapping, ImageFile &image)
+        {
+            const auto *data = mapping.as<unsigned char>();
+            const size_t size = mapping.size();
+            size_t offset = 0u;
+            const auto magic = next_token(data, size, offset);
+            uint32_t width = 0u, height = 0u, channels = 0u, maxval = 0u;
+            if (magic == "P6" || magic == "P5")
+            {
+                width = to_uint(next_token(data, size, offset));
+                height = to_uint(next_token(data, size, offset));
+                maxval = to_uint(next_token(data, size, offset));
+                channels = magic == "P6" ? 3u : 1u;
+                ++offset; // the single whitespace byte before the samples
+            }
+            else if (magic == "P7")
+            {
+                for (;;)
+                {
+                    const auto key = next_token(data, size, offset);
+                    if (key.empty())
+                        return "truncated PAM header";
+                    if (key == "ENDHDR")
+                        break;
+                    const auto value = next_token(data, size, offset);
+                    if (key == "WIDTH")
+                        width = to_uint(value);
+                    else if (key == "HEIGHT")
+                        height = to_uint(value);
+                    else if (key == "DEPTH")
+                        channels = to_uint(value);
+                    else if (key == "MAXVAL")
+                        maxval = to_uint(value);
+                }
+                ++offset;
+            }
+            else
+                return "not a binary netpbm file (P5, P6 or P7)";
+            if (width == 0u || height == 0u || channels == 0u || channels > 4u)
+                return "invalid netpbm header";
+            if (maxval != 255u)
+                return "only 8-bit netpbm files are supported";
+            if (offset + static_cast<size_t>(width) * height * channels > size)
+                return "truncated netpbm file";
+            if (channels == 4u)
+                image.set_mapped(width, height, std::move(mapping), offset);
+            else
+                image.set(width, height, expand_to_rgba(data + offset, width, height, channels));
+            return nullptr;
+        }
+
+        // QOI (https://qoiformat.org), RGBA8 output regardless of the channel count in the header.
+        constexpr uint8_t qoi_op_index = 0x00u;
+        constexpr uint8_t qoi_op_diff = 0x40u;
+        constexpr uint8_t qoi_op_luma = 0x80u;
+        constexpr uint8_t qoi_op_run = 0xc0u;
+        constexpr uint8_t qoi_op_rgb = 0xfeu;
+        constexpr uint8_t qoi_op_rgba = 0xffu;
+        constexpr uint8_t qoi_end[8] = {0u, 0u, 0u, 0u, 0u, 0u, 0u, 1u};
+
+        inline uint32_t qoi_hash(const uint8_t *p) noexcept { return (p[0] * 3u + p[1] * 5u + p[2] * 7u + p[3] * 11u) % 64u; }
+
+        inline uint32_t read_be32(const unsigned char *p) noexcept
+        {
+            return (static_cast<uint32_t>(p[0]) << 24u) | (static_cast<uint32_t>(p[1]) << 16u) | (static_cast<uint32_t>(p[2]) << 8u) | p[3];
+        }
+
+        inline void write_be32(std::vector<unsigned char> &out, uint32_t v)
+        {
+            out.push_back(static_cast<unsigned char>(v >> 24u));
+            out.push_back(static_cast<unsigned char>(v >> 16u));
+            out.push_back(static_cast<unsigned char>(v >> 8u));
+            out.push_back(static_cast<unsigned char>(v));
+        }
+
+        inline const char *read_qoi(const MappedFile &mapping, ImageFile &image)
+        {
+            const auto *data = mapping.as<unsigned char>();
+            const size_t size = mapping.size();
+            if (size < 14u + sizeof(qoi_end) || std::memcmp(data, "qoif", 4u) != 0)
+                return "not a QOI file";
+            const uint32_t width = read_be32(data + 4u);
+            const uint32_t height = read_be32(data + 8u);
+            if (width == 0u || height == 0u || static_cast<uint64_t>(width) * height > (1ull << 31u))
+                return "invalid QOI header";
+            std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4u);
+            std::array<uint8_t, 64u * 4u> index{};
+            uint8_t px[4] = {0u, 0u, 0u, 255u};
+            size_t p = 14u;
+            const size_t end = size - sizeof(qoi_end);
+            uint32_t run = 0u;
+            for (size_t out = 0u; out < rgba.size(); out += 4u)
+            {
+                if (run > 0u)
+                    --run;
+                else if (p < end)
+                {
+                    const uint8_t b = data[p++];
+                    if (b == qoi_op_rgb)
+                    {
+                        px[0] = data[p];
+                        px[1] = data[p + 1u];
+                        px[2] = data[p + 2u];
+                        p += 3u;
+                    }
+                    else if (b == qoi_op_rgba)
+                    {
+                        std::memcpy(px, data + p, 4u);
+                        p += 4u;
+                    }
+                    else if ((b & 0xc0u) == qoi_op_index)
+                        std::memcpy(px, index.data() + b * 4u, 4u);
+                    else if ((b & 0xc0u) == qoi_op_diff)
+                    {
+                        px[0] += ((b >> 4u) & 3u) - 2u;
+                        px[1] += ((b >> 2u) & 3u) - 2u;
+                        px[2] += (b & 3u) - 2u;
+                    }
+                    else if ((b & 0xc0u) == qoi_op_luma)
+                    {
+                        const uint8_t b2 = data[p++];
+                        const int dg = static_cast<int>(b & 0x3fu) - 32;
+                        px[0] += static_cast<uint8_t>(dg - 8 + ((b2 >> 4u) & 0x0f));
+                        px[1] += static_cast<uint8_t>(dg);
+                        px[2] += static_cast<uint8_t>(dg - 8 + (b2 & 0x0f));
+                    }
+                    else
+                        run = b & 0x3fu;
+                    std::memcpy(index.data() + qoi_hash(px) * 4u, px, 4u);
+                }
+                std::memcpy(rgba.data() + out, px, 4u);
+            }
+            image.set(width, height, std::move(rgba));
+            return nullptr;
+        }
+
+        inline void encode_qoi(std::vector<unsigned char> &out, const unsigned char *rgba, uint32_t width, uint32_t height)
+        {
+            const size_t pixels = static_cast<size_t>(width) * height;
+            out.clear();
+            out.reserve(14u + pixels * 5u / 2u + sizeof(qoi_end));
+            out.insert(out.end(), {'q', 'o', 'i', 'f'});
+            write_be32(out, width);
+            write_be32(out, height);
+            out.push_back(4u);
+            out.push_back(0u);
+            std::array<uint8_t, 64u * 4u> index{};
+            uint8_t previous[4] = {0u, 0u, 0u, 255u};
+            uint32_t run = 0u;
+            for (size_t i = 0u; i < pixels; ++i)
+            {
+                const uint8_t *px = rgba + i * 4u;
+                if (std::memcmp(px, previous, 4u) == 0)
+                {
+                    if (++run == 62u || i + 1u == pixels)
+                    {
+                        out.push_back(static_cast<unsigned char>(qoi_op_run | (run - 1u)));
+                        run = 0u;
+                    }
+                    continue;
+                }
+                if (run > 0u)
+                {
+                    out.push_back(static_cast<unsigned char>(qoi_op_run | (run - 1u)));
+                    run = 0u;
+                }
+                const uint32_t h = qoi_hash(px);
+                if (std::memcmp(index.data() + h * 4u, px, 4u) == 0)
+                    out.push_back(static_cast<unsigned char>(qoi_op_index | h));
+                else
+                {
+                    std::memcpy(index.data() + h * 4u, px, 4u);
+                    if (px[3] == previous[3])
+                    {
+                        const int8_t dr = static_cast<int8_t>(px[0] - previous[0]);
+                        const int8_t dg = static_cast<int8_t>(px[1] - previous[1]);
+                        const int8_t db = static_cast<int8_t>(px[2] - previous[2]);
+                        const int8_t dr_dg = static_cast<int8_t>(dr - dg);
+                        const int8_t db_dg = static_cast<int8_t>(db - dg);
+                        if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+                            out.push_back(static_cast<unsigned char>(qoi_op_diff | (dr + 2) << 4u | (dg + 2) << 2u | (db + 2)));
+                        else if (dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8)
+                        {
+                            out.push_back(static_cast<unsigned char>(qoi_op_luma | (dg + 32)));
+                            out.push_back(static_cast<unsigned char>((dr_dg + 8) << 4u | (db_dg + 8)));
+                        }
+                        else
+                            out.insert(out.end(), {qoi_op_rgb, px[0], px[1], px[2]});
+                    }
+                    else
+                        out.insert(out.end(), {qoi_op_rgba, px[0], px[1], px[2], px[3]});
+                }
+                std::memcpy(previous, px, 4u);
+            }
+            out.insert(out.end(), std::begin(qoi_end), std::end(qoi_end));
+        }
+
+        // PFM: "PF" (RGB) or "Pf" (gray), width height, then a scale whose sign gives the byte order, then float
+        // rows from the bottom up.
+        inline const char *read_pfm(const MappedFile &mapping, std::vector<float> &values, uint32_t &width, uint32_t &height, uint32_t &channels)
+        {
+            const auto *data = mapping.as<unsigned char>();
+            const size_t size = mapping.size();
+            size_t offset = 0u;
+            const auto magic = next_token(data, size, offset);
+            if (magic != "PF" && magic != "Pf")
+                return "not a PFM file";
+            channels = magic == "PF" ? 3u : 1u;
+            width = to_uint(next_token(data, size, offset));
+            height = to_uint(next_token(data, size, offset));
+            const float scale = std::strtof(std::string(next_token(data, size, offset)).c_str(), nullptr);
+            ++offset;
+            const size_t row = static_cast<size_t>(width) * channels;
+            if (width == 0u || height == 0u || scale == 0.0f)
+                return "invalid PFM header";
+            if (offset + row * height * sizeof(float) > size)
+                return "truncated PFM file";
+            if (scale > 0.0f)
+                return "big-endian PFM files are not supported";
+            values.resize(row * height);
+            for (uint32_t y = 0u; y < height; ++y)
+                std::memcpy(values.data() + static_cast<size_t>(y) * row, data + offset + (static_cast<size_t>(height - 1u - y) * row) * sizeof(float), row * sizeof(float));
+            return nullptr;
+        }
+
+        inline uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0u) noexcept
+        {
+            static const auto table = []
+            {
+                std::array<uint32_t, 256u> t{};
+                for (uint32_t n = 0u; n < 256u; ++n)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k)
+                        c = c & 1u ? 0xedb88320u ^ (c >> 1u) : c >> 1u;
+                    t[n] = c;
+                }
+                return t;
+            }();
+            crc = ~crc;
+            for (size_t i = 0u; i < size; ++i)
+                crc = table[(crc ^ data[i]) & 0xffu] ^ (crc >> 8u);
+            return ~crc;
+        }
+
+        inline void png_chunk(std::vector<unsigned char> &out, const char type[4], const unsigned char *data, size_t size)
+        {
+            write_be32(out, static_cast<uint32_t>(size));
+            const size_t begin = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data, data + size);
+            write_be32(out, crc32(out.data() + begin, size + 4u));
+        }
+
+        inline uint8_t paeth(int a, int b, int c) noexcept
+        {
+            const int p = a + b - c;
+            const int pa = std::abs(p - a);
+            const int pb = std::abs(p - b);
+            const int pc = std::abs(p - c);
+            return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+        }
+
+        // RGBA8 PNG with every row filtered on its own thread, trying all five filters and keeping the one with the
+        // smallest sum of absolute residuals (lodepng's LFS_MINSUM), then one deflate pass with a small window and
+        // no lazy matching.
+        inline unsigned encode_png_fast(std::vector<unsigned char> &out, const unsigned char *rgba, uint32_t width, uint32_t height)
+        {
+            const size_t stride = static_cast<size_t>(width) * 4u;
+            std::vector<unsigned char> filtered((stride + 1u) * height);
+#pragma omp parallel for schedule(dynamic, 16)
+            for (int64_t y = 0; y < static_cast<int64_t>(height); ++y)
+            {
+                const unsigned char *row = rgba + static_cast<size_t>(y) * stride;
+                const unsigned char *up = y > 0 ? row - stride : nullptr;
+                unsigned char *dst = filtered.data() + static_cast<size_t>(y) * (stride + 1u);
+                std::vector<unsigned char> candidate(stride);
+                uint64_t best_sum = ~0ull;
+                for (uint8_t type = 0u; type < 5u; ++type)
+                {
+                    uint64_t sum = 0u;
+                    for (size_t i = 0u; i < stride; ++i)
+                    {
+                        const int a = i >= 4u ? row[i - 4u] : 0;
+                        const int b = up ? up[i] : 0;
+                        const int c = up && i >= 4u ? up[i - 4u] : 0;
+                        int predicted = 0;
+                        switch (type)
+                        {
+                        case 1u:
+                            predicted = a;
+                            break;
+                        case 2u:
+                            predicted = b;
+                            break;
+                        case 3u:
+                            predicted = (a + b) / 2;
+                            break;
+                        case 4u:
+                            predicted = paeth(a, b, c);
+                            break;
+                        }
+                        const auto residual = static_cast<unsigned char>(row[i] - predicted);
+                        candidate[i] = residual;
+                        sum += residual < 128u ? residual : 256u - residual;
+                    }
+                    if (sum < best_sum)
+                    {
+                        best_sum = sum;
+                        dst[0] = type;
+                        std::memcpy(dst + 1u, candidate.data(), stride);
+                    }
+                }
+            }
+
+            LodePNGCompressSettings settings;
+            lodepng_compress_settings_init(&settings);
+            settings.windowsize = 2048u;
+            settings.nicematch = 32u;
+            settings.lazymatching = 0u;
+            std::vector<unsigned char> zlib;
+            if (auto error = lodepng::compress(zlib, filtered.data(), filtered.size(), settings))
+                return error;
+
+            static constexpr unsigned char signature[8] = {137u, 80u, 78u, 71u, 13u, 10u, 26u, 10u};
+            std::vector<unsigned char> header;
+            write_be32(header, width);
+            write_be32(header, height);
+            header.insert(header.end(), {8u, 6u, 0u, 0u, 0u}); // 8-bit RGBA, deflate, adaptive filtering, no interlace
+            out.assign(std::begin(signature), std::end(signature));
+            out.reserve(out.size() + zlib.size() + 64u);
+            png_chunk(out, "IHDR", header.data(), header.size());
+            png_chunk(out, "IDAT", zlib.data(), zlib.size());
+            png_chunk(out, "IEND", nullptr, 0u);
+            return 0u;
+        }
+
+        // RGBA8 PAM, the format read_image maps without decoding.
+        inline std::string pam_header(uint32_t width, uint32_t height)
+        {
+            return "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+        }
+
+        inline const char *write_file(const std::string &path, const std::string &header, const unsigned char *data, size_t size)
+        {
+            std::ofstream file(path, std::ios::binary);
+            file.write(header.data(), static_cast<std::streamsize>(header.size()));
+            file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+            return file ? nullptr : "cannot write image file";
+        }
+    }
+
+    // Whether read_image knows the extension of `path`.
+    inline bool is_image_path(const std::filesystem::path &path)
+    {
+        const auto extension = detail::lowercase_extension(path.string());
+        return extension == ".png" || extension == ".ppm" || extension == ".pgm" || extension == ".pam" || extension == ".qoi" || extension == ".pfm";
+    }
+
+    inline const char *read_image(const std::string &path, ImageFile &image)
+    {
+        MappedFile mapping(path);
+        if (!mapping)
+            return "cannot open image file";
+        const auto extension = detail::lowercase_extension(path);
+        if (extension == ".ppm" || extension == ".pgm" || extension == ".pam")
+            return detail::read_netpbm(std::move(mapping), image);
+        if (extension == ".qoi")
+            return detail::read_qoi(mapping, image);
+        if (extension == ".pfm")
+        {
+            std::vector<float> values;
+            uint32_t width, height, channels;
+            if (auto error = detail::read_pfm(mapping, values, width, height, channels))
+                return error;
+            std::vector<unsigned char> samples(values.size());
+            for (size_t i = 0u; i < values.size(); ++i)
+                samples[i] = static_cast<unsigned char>(std::clamp(values[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+            image.set(width, height, detail::expand_to_rgba(samples.data(), width, height, channels));
+            return nullptr;
+        }
+        std::vector<unsigned char> pixels;
+        unsigned width, height;
+        if (auto error = lodepng::decode(pixels, width, height, mapping.as<unsigned char>(), mapping.size()))
+            return lodepng_error_text(error);
+        image.set(width, height, std::move(pixels));
+        return nullptr;
+    }
+
+    // Encodes RGBA8 pixels into memory, in the format given by an extension such as ".qoi".
+    inline const char *encode_image(std::vector<unsigned char> &out, std::string_view extension, const unsigned char *rgba, uint32_t width, uint32_t height, const ImageWriteOptions &options = {})
+    {
+        if (extension == ".pam" || extension == ".ppm")
+        {
+            const bool pam = extension == ".pam";
+            const auto header = pam ? detail::pam_header(width, height)
+                                    : "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+            const size_t pixels = static_cast<size_t>(width) * height;
+            out.resize(header.size() + pixels * (pam ? 4u : 3u));
+            std::memcpy(out.data(), header.data(), header.size());
+            if (pam)
+                std::memcpy(out.data() + header.size(), rgba, pixels * 4u);
+            else
+                for (size_t i = 0u; i < pixels; ++i)
+                    std::memcpy(out.data() + header.size() + i * 3u, rgba + i * 4u, 3u);
+            return nullptr;
+        }
+        if (extension == ".qoi")
+        {
+            detail::encode_qoi(out, rgba, width, height);
+            return nullptr;
+        }
+        if (extension != ".png")
+            return "unsupported output image format";
+        out.clear();
+        const auto error = options.fast_png ? detail::encode_png_fast(out, rgba, width, height) : lodepng::encode(out, rgba, width, height);
+        return error ? lodepng_error_text(error) : nullptr;
+    }
+
+    inline const char *write_image(const std::string &path, const unsigned char *rgba, uint32_t width, uint32_t height, const ImageWriteOptions &options = {})
+    {
+        const auto extension = detail::lowercase_extension(path);
+        // The uncompressed formats go straight from the pixels to the file.
+        if (extension == ".pam")
+            return detail::write_file(path, detail::pam_header(width, height),
+                                      rgba, static_cast<size_t>(width) * height * 4u);
+        std::vector<unsigned char> encoded;
+        if (auto error = encode_image(encoded, extension, rgba, width, height, options))
+            return error;
+        return detail::write_file(path, {}, encoded.data(), encoded.size());
+    }
+
+    inline const char *write_image(const std::string &path, const std::vector<unsigned char> &rgba, uint32_t width, uint32_t height, const ImageWriteOptions &options = {})
+    {
+        return write_image(path, rgba.data(), width, height, options);
+    }
+
+    // Writes a 1 (gray) or 3 (RGB) channel float map as little-endian PFM, e.g. an energy or cost map.
+    inline const char *write_float_image(const std::string &path, const float *values, uint32_t width, uint32_t height, uint32_t channels = 1u)
+    {
+        if (channels != 1u && channels != 3u)
+            return "PFM holds 1 or 3 channels";
+        const size_t row = static_cast<size_t>(width) * channels;
+        std::vector<float> flipped(row * height);
+        for (uint32_t y = 0u; y < height; ++y)
+            std::memcpy(flipped.data() + static_cast<size_t>(y) * row, values + static_cast<size_t>(height - 1u - y) * row, row * sizeof(float));
+        const auto header = std::string(channels == 3u ? "PF\n" : "Pf\n") + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+        return detail::write_file(path, header, reinterpret_cast<const unsigned char *>(flipped.data()), flipped.size() * sizeof(float));
+    }
+
+    inline const char *read_float_image(const std::string &path, std::vector<float> &values, uint32_t &width, uint32_t &height, uint32_t &channels)
+    {
+        MappedFile mapping(path);
+        if (!mapping)
+            return "cannot open image file";
+        return detail::read_pfm(mapping, values, width, height, channels);
+    }
+}
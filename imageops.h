@@ -0,0 +1,231 @@
+#pragma once
+
+#include <luisa-compute.h>
+#include <shadercache.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lct
+{
+    // One pointwise operation of an ImageOpGraph. Its parameters go to a buffer, so they can change without a
+    // recompile; only the kind is part of the fused shader.
+    struct ImageOp
+    {
+        enum class Kind : uint32_t
+        {
+            luminance,   // rgb = dot(rgb, weights), alpha = 1
+            tone_map,    // Reinhard on rgb after scaling by the exposure
+            channel_mix, // rgba = rows * rgba
+        };
+
+        Kind kind;
+        std::vector<luisa::float4> parameters;
+
+        [[nodiscard]] static ImageOp luminance(luisa::float3 weights = luisa::make_float3(0.2126f, 0.7152f, 0.0722f))
+        {
+            return {Kind::luminance, {luisa::make_float4(weights, 0.0f)}};
+        }
+        [[nodiscard]] static ImageOp tone_map(float exposure = 1.0f)
+        {
+            return {Kind::tone_map, {luisa::make_float4(exposure)}};
+        }
+        [[nodiscard]] static ImageOp channel_mix(luisa::float4 r, luisa::float4 g, luisa::float4 b, luisa::float4 a = luisa::make_float4(0.0f, 0.0f, 0.0f, 1.0f))
+        {
+            return {Kind::channel_mix, {r, g, b, a}};
+        }
+
+        [[nodiscard]] static const char *name(Kind kind) noexcept
+        {
+            switch (kind)
+            {
+            case Kind::luminance:
+                return "luminance";
+            case Kind::tone_map:
+                return "tone_map";
+            default:
+                return "channel_mix";
+            }
+        }
+        // Affine ops commute with filtering (the filter weights sum to one), so they can run after a hardware sample.
+        [[nodiscard]] static bool affine(Kind kind) noexcept { return kind != Kind::tone_map; }
+    };
+
+    // A chain of pointwise ops ending in a resample of bindless texture 0 to the dispatch extent of the output,
+    // traced into a single kernel.
+    // - Nearest reads one texel and applies the chain to it.
+    // - Bilinear with only affine ops applies the chain to one hardware sample; slot 0 must then use a linear
+    //   filter with repeat addressing. With a non-affine op it reads the four texels, applies the chain to each and
+    //   blends, the same result as running the chain at full resolution first.
+    class ImageOpGraph
+    {
+    public:
+        enum class Filter : uint32_t
+        {
+            nearest,
+            bilinear,
+        };
+
+    private:
+        std::vector<ImageOp::Kind> _kinds;
+        std::vector<luisa::float4> _parameters;
+        Filter _filter = Filter::bilinear;
+
+    public:
+        ImageOpGraph &then(const ImageOp &op)
+        {
+            _kinds.push_back(op.kind);
+            _parameters.insert(_parameters.end(), op.parameters.begin(), op.parameters.end());
+            return *this;
+        }
+
+        ImageOpGraph &resample(Filter filter)
+        {
+            _filter = filter;
+            return *this;
+        }
+
+        // Sets the parameters of the op at `index`, in place, for the next dispatch.
+        void set(size_t index, const ImageOp &op)
+        {
+            size_t offset = 0u;
+            for (size_t i = 0u; i < index; ++i)
+                offset += parameter_count(_kinds[i]);
+            std::copy(op.parameters.begin(), op.parameters.end(), _parameters.begin() + offset);
+        }
+
+        [[nodiscard]] const std::vector<luisa::float4> &parameters() const noexcept { return _parameters; }
+        [[nodiscard]] Filter filter() const noexcept { return _filter; }
+
+        [[nodiscard]] static size_t parameter_count(ImageOp::Kind kind) noexcept { return kind == ImageOp::Kind::channel_mix ? 4u : 1u; }
+
+        [[nodiscard]] bool affine() const noexcept
+        {
+            for (auto kind : _kinds)
+                if (!ImageOp::affine(kind))
+                    return false;
+            return true;
+        }
+
+        // "<op>.<op>...<filter>", the key of the fused shader.
+        [[nodiscard]] std::string signature() const
+        {
+            std::string signature;
+            for (auto kind : _kinds)
+                signature.append(ImageOp::name(kind)).append(".");
+            return signature + (_filter == Filter::nearest ? "nearest" : "bilinear");
+        }
+
+        [[nodiscard]] auto make_kernel() const
+        {
+            return luisa::compute::Kernel2D{[kinds = _kinds, filter = _filter, affine = affine()](luisa::compute::BindlessVar from, luisa::compute::BufferFloat4 parameters, luisa::compute::ImageFloat to) noexcept
+                                            {
+                                                auto apply = [&](luisa::compute::Float4 color)
+                                                {
+                                                    luisa::uint offset = 0u;
+                                                    for (auto kind : kinds)
+                                                    {
+                                                        switch (kind)
+                                                        {
+                                                        case ImageOp::Kind::luminance:
+                                                            color = luisa::compute::make_float4(luisa::compute::make_float3(luisa::compute::dot(color.xyz(), parameters.read(offset).xyz())), 1.0f);
+                                                            break;
+                                                        case ImageOp::Kind::tone_map:
+                                                        {
+                                                            luisa::compute::Var scaled = color.xyz() * parameters.read(offset).x;
+                                                            color = luisa::compute::make_float4(scaled / (1.0f + scaled), color.w);
+                                                            break;
+                                                        }
+                                                        case ImageOp::Kind::channel_mix:
+                                                            color = luisa::compute::make_float4(luisa::compute::dot(parameters.read(offset), color),
+                                                                                                luisa::compute::dot(parameters.read(offset + 1u), color),
+                                                                                                luisa::compute::dot(parameters.read(offset + 2u), color),
+                                                                                                luisa::compute::dot(parameters.read(offset + 3u), color));
+                                                            break;
+                                                        }
+                                                        offset += static_cast<luisa::uint>(parameter_count(kind));
+                                                    }
+                                                    return color;
+                                                };
+
+                                                luisa::compute::Var coord = luisa::compute::dispatch_id().xy();
+                                                luisa::compute::Var normalized_coord = luisa::compute::make_float2(coord) / luisa::compute::make_float2(luisa::compute::dispatch_size().xy());
+                                                luisa::compute::Float4 color;
+                                                if (filter == Filter::bilinear && affine)
+                                                    color = apply(from.tex2d(0u).sample(normalized_coord));
+                                                else
+                                                {
+                                                    luisa::compute::Var size = from.tex2d(0u).size();
+                                                    if (filter == Filter::nearest)
+                                                        color = apply(from.tex2d(0u).read(luisa::compute::min(luisa::compute::make_uint2(normalized_coord * luisa::compute::make_float2(size)), size - 1u)));
+                                                    else
+                                                    {
+                                                        luisa::compute::Var position = normalized_coord * luisa::compute::make_float2(size) - 0.5f;
+                                                        luisa::compute::Var base = luisa::compute::floor(position);
+                                                        luisa::compute::Var weight = position - base;
+                                                        luisa::compute::Var signed_size = luisa::compute::make_int2(size);
+                                                        luisa::compute::Var texel = (luisa::compute::make_int2(base) % signed_size + signed_size) % signed_size;
+                                                        luisa::compute::Var next = (texel + 1) % signed_size;
+                                                        luisa::compute::Var c00 = apply(from.tex2d(0u).read(luisa::compute::make_uint2(texel)));
+                                                        luisa::compute::Var c10 = apply(from.tex2d(0u).read(luisa::compute::make_uint2(next.x, texel.y)));
+                                                        luisa::compute::Var c01 = apply(from.tex2d(0u).read(luisa::compute::make_uint2(texel.x, next.y)));
+                                                        luisa::compute::Var c11 = apply(from.tex2d(0u).read(luisa::compute::make_uint2(next)));
+                                                        luisa::compute::Var top = c00 + (c10 - c00) * weight.x;
+                                                        luisa::compute::Var bottom = c01 + (c11 - c01) * weight.x;
+                                                        color = top + (bottom - top) * weight.y;
+                                                    }
+                                                }
+                                                to.write(coord, color);
+                                            }};
+        }
+    };
+
+    // Fused ImageOpGraph shaders, compiled through a ShaderCache once per signature, each with a parameter buffer.
+    class ImageOpShaders
+    {
+    public:
+        using shader_type = luisa::compute::Shader2D<luisa::compute::BindlessArray, luisa::compute::Buffer<luisa::float4>, luisa::compute::Image<float>>;
+
+    private:
+        struct Entry
+        {
+            shader_type shader;
+            luisa::compute::Buffer<luisa::float4> parameters;
+        };
+
+        luisa::compute::Device &_device;
+        ShaderCache &_cache;
+        std::unordered_map<std::string, Entry> _entries;
+
+    public:
+        ImageOpShaders(luisa::compute::Device &device, ShaderCache &cache) : _device(device), _cache(cache) {}
+
+        // Compiles (or finds) the fused shader of `graph`, e.g. ahead of time for --precompile.
+        Entry &prepare(const ImageOpGraph &graph)
+        {
+            auto signature = graph.signature();
+            auto iter = _entries.find(signature);
+            if (iter == _entries.end())
+            {
+                auto shader = _cache.compile(graph.make_kernel(), "fused." + signature);
+                auto parameters = _device.create_buffer<luisa::float4>(std::max<size_t>(graph.parameters().size(), 1u));
+                iter = _entries.emplace(std::move(signature), Entry{std::move(shader), std::move(parameters)}).first;
+            }
+            return iter->second;
+        }
+
+        // Uploads the parameters of `graph` and resamples `from` into `to` in one dispatch. The graph must stay
+        // alive until the commands have run.
+        void record(luisa::compute::CommandList &cmds, const ImageOpGraph &graph, const luisa::compute::BindlessArray &from, const luisa::compute::Image<float> &to)
+        {
+            auto &entry = prepare(graph);
+            if (!graph.parameters().empty())
+                cmds << entry.parameters.copy_from(graph.parameters().data());
+            cmds << entry.shader(from, entry.parameters, to).dispatch(to.size());
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return _entries.size(); }
+    };
+}
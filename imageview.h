@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace lct
+{
+    // Non-owning view of a row-major image with an explicit row stride, in elements. Vertical seams are closed in
+    // place and shorten every row: a tight view shortens its stride with it so it stays tight, while a view into a
+    // wider image keeps its stride and never touches the pixels right of it.
+    template <typename T>
+    struct StridedImageView
+    {
+        T *data = nullptr;
+        uint32_t width = 0u;
+        uint32_t height = 0u;
+        uint32_t stride = 0u;
+
+        [[nodiscard]] T *row(uint32_t y) const noexcept { return data + static_cast<size_t>(y) * stride; }
+        [[nodiscard]] T &operator()(uint32_t x, uint32_t y) const noexcept { return row(y)[x]; }
+        [[nodiscard]] bool contiguous() const noexcept { return stride == width; }
+        [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(stride) * height; }
+
+        // seam[y] is the column removed from row y. Rows only move towards the front, two memmoves each in a tight
+        // view and one within the row otherwise.
+        void close_vertical_seam(const uint32_t *seam) noexcept
+        {
+            const bool tight = contiguous();
+            for (uint32_t y = 0u; y < height; ++y)
+            {
+                const uint32_t s = seam[y];
+                T *src = row(y);
+                if (!tight)
+                {
+                    std::memmove(src + s, src + s + 1u, (width - 1u - s) * sizeof(T));
+                    continue;
+                }
+                T *dst = data + static_cast<size_t>(y) * (stride - 1u);
+                std::memmove(dst, src, s * sizeof(T));
+                std::memmove(dst + s, src + s + 1u, (width - 1u - s) * sizeof(T));
+            }
+            --width;
+            if (tight)
+                --stride;
+        }
+    };
+}
@@ -2,6 +2,8 @@
 
 #include <luisa-compute.h>
 #include <lodepng.h>
+#include <backend.h>
+#include <shadercache.h>
 
 using namespace luisa;
 using namespace luisa::compute;
@@ -11,9 +13,10 @@ Float4 extCallable()
     return make_float4(0.0f, 0.0f, 1.0f, 1.0f);
 }
 
-int main(int, char** argv){
+int main(int argc, char** argv){
+    bool precompile = argc > 1 && std::string_view(argv[1]) == "--precompile";
     Context context{argv[0]};
-    Device device = context.create_device("cuda");
+    Device device = lct::create_device(context);
     Stream stream = device.create_stream();
 
     Image<float> device_image = device.create_image<float>(PixelStorage::BYTE4, make_uint2(1024u, 1024u), 0u);
@@ -29,7 +32,13 @@ int main(int, char** argv){
         image->write(coord, lambda_callable());
     };
 
-    auto fill_image = device.compile(kernel);
+    auto fill_image = [&] {
+        lct::ShaderCache cache(context, device, "lct", precompile);
+        auto shader = cache.compile(kernel, "fill_image");
+        cache.report();
+        return shader;
+    }();
+    if (precompile) return 0;
     std::vector<unsigned char> downloaded_image(1024u * 1024u * 4u);
     stream << fill_image(device_image.view(0)).dispatch(1024u, 1024u) << device_image.copy_to(downloaded_image.data()) << synchronize();
 
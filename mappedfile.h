@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lct
+{
+    // Read-only memory mapping of a whole file. Empty (and falsy) if the file cannot be opened or is empty.
+    class MappedFile
+    {
+        const std::byte *_data = nullptr;
+        size_t _size = 0u;
+#ifdef _WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+#endif
+
+        void release() noexcept
+        {
+#ifdef _WIN32
+            if (_data != nullptr)
+                UnmapViewOfFile(_data);
+            if (_mapping != nullptr)
+                CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE)
+                CloseHandle(_file);
+            _file = INVALID_HANDLE_VALUE;
+            _mapping = nullptr;
+#else
+            if (_data != nullptr)
+                munmap(const_cast<std::byte *>(_data), _size);
+#endif
+            _data = nullptr;
+            _size = 0u;
+        }
+
+    public:
+        MappedFile() noexcept = default;
+
+        explicit MappedFile(const std::string &path)
+        {
+#ifdef _WIN32
+            _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER size;
+            if (_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file, &size) || size.QuadPart == 0 ||
+                (_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr)) == nullptr)
+            {
+                release();
+                return;
+            }
+            _data = static_cast<const std::byte *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+            _size = _data == nullptr ? 0u : static_cast<size_t>(size.QuadPart);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    _data = static_cast<const std::byte *>(data);
+                    _size = static_cast<size_t>(info.st_size);
+                }
+            }
+            ::close(fd);
+#endif
+        }
+
+        MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+        MappedFile &operator=(MappedFile &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                std::swap(_data, other._data);
+                std::swap(_size, other._size);
+#ifdef _WIN32
+                std::swap(_file, other._file);
+                std::swap(_mapping, other._mapping);
+#endif
+            }
+            return *this;
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile() { release(); }
+
+        [[nodiscard]] const std::byte *data() const noexcept { return _data; }
+        [[nodiscard]] size_t size() const noexcept { return _size; }
+        [[nodiscard]] explicit operator bool() const noexcept { return _data != nullptr; }
+
+        template <typename T>
+        [[nodiscard]] const T *as(size_t offset = 0u) const noexcept { return reinterpret_cast<const T *>(_data + offset); }
+    };
+}
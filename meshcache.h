@@ -0,0 +1,485 @@
+#pragma once
+
+#include <objloader.h>
+#include <mappedfile.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lct
+{
+    // "<obj>.lctmesh" is a versioned binary image of a MeshData. Every section starts on a 64-byte boundary and is
+    // stored in the layout the device wants, so a mapped cache uploads straight from the mapping:
+    //   positions  float[4] per vertex, the layout of a float3 buffer
+    //   normals    float[4] per vertex, or oct-encoded snorm16[2] when quantized (only if the OBJ has normals)
+    //   texcoords  float[2] per vertex, or half[2] when quantized (only if the OBJ has texcoords)
+    //   indices    uint32 triangles, relative to the first vertex of their range
+    //   ranges     one MeshCacheRange per (shape, material)
+    //   materials  MeshCacheMaterial
+    //   strings    names referenced by ranges and materials
+    // The header records the size, mtime and FNV-1a hash of the source OBJ. A cache whose size and mtime match is
+    // trusted; when only the mtime differs the source is hashed, so a touched or copied OBJ keeps its cache.
+    constexpr char mesh_cache_magic[8] = {'L', 'C', 'T', 'M', 'E', 'S', 'H', '\0'};
+    constexpr uint32_t mesh_cache_version = 1u;
+    constexpr uint64_t mesh_cache_alignment = 64u;
+    constexpr uint32_t mesh_cache_normals = 1u;
+    constexpr uint32_t mesh_cache_texcoords = 2u;
+    constexpr uint32_t mesh_cache_quantized = 4u;
+
+    struct MeshCacheString
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct MeshCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t source_hash;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t range_count;
+        uint32_t material_count;
+        uint64_t positions_offset;
+        uint64_t normals_offset;
+        uint64_t texcoords_offset;
+        uint64_t indices_offset;
+        uint64_t ranges_offset;
+        uint64_t materials_offset;
+        uint64_t strings_offset;
+        uint64_t file_size;
+    };
+
+    struct MeshCacheRange
+    {
+        MeshCacheString name;
+        int32_t material_id;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+        uint32_t padding;
+    };
+    static_assert(sizeof(MeshCacheRange) == 32u);
+
+    struct MeshCacheMaterial
+    {
+        MeshCacheString name;
+        MeshCacheString diffuse_texname;
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+        float transmittance[3];
+        float emission[3];
+        float shininess;
+        float ior;
+        float dissolve;
+        int32_t illum;
+    };
+
+    inline uint64_t hash_file(const std::string &path)
+    {
+        MappedFile file(path);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0u; i < file.size(); ++i)
+            hash = (hash ^ static_cast<uint8_t>(file.data()[i])) * 1099511628211ull;
+        return hash;
+    }
+
+    inline int64_t file_mtime(const std::string &path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    // Octahedral normal encoding, two snorm16 per unit vector.
+    inline void encode_octahedral(const float n[3], int16_t out[2]) noexcept
+    {
+        const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+        float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+        if (n[2] < 0.0f)
+        {
+            const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+        out[0] = static_cast<int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+        out[1] = static_cast<int16_t>(std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    inline void decode_octahedral(const int16_t in[2], float n[3]) noexcept
+    {
+        float x = static_cast<float>(in[0]) / 32767.0f;
+        float y = static_cast<float>(in[1]) / 32767.0f;
+        const float z = 1.0f - std::abs(x) - std::abs(y);
+        if (z < 0.0f)
+        {
+            const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+        const float length = std::sqrt(x * x + y * y + z * z);
+        n[0] = x / length;
+        n[1] = y / length;
+        n[2] = z / length;
+    }
+
+    // IEEE half conversions, round to nearest even; out-of-range values saturate to infinity.
+    inline uint16_t float_to_half(float value) noexcept
+    {
+        const auto bits = std::bit_cast<uint32_t>(value);
+        const uint32_t sign = (bits >> 16u) & 0x8000u;
+        const uint32_t abs = bits & 0x7fffffffu;
+        if (abs >= 0x7f800000u)
+            return static_cast<uint16_t>(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+        if (abs >= 0x477ff000u)
+            return static_cast<uint16_t>(sign | 0x7c00u);
+        if (abs < 0x38800000u)
+        {
+            // Subnormal half: shift the implicit-one mantissa into place with round to nearest even.
+            if (abs < 0x33000000u)
+                return static_cast<uint16_t>(sign);
+            const uint32_t exponent = abs >> 23u;
+            const uint32_t mantissa = (abs & 0x7fffffu) | 0x800000u;
+            const uint32_t shift = 126u - exponent;
+            uint32_t half = mantissa >> shift;
+            const uint32_t rest = mantissa & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1u);
+            if (rest > halfway || (rest == halfway && (half & 1u)))
+                ++half;
+            return static_cast<uint16_t>(sign | half);
+        }
+        uint32_t half = ((abs - 0x38000000u) >> 13u);
+        const uint32_t rest = abs & 0x1fffu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+            ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    inline float half_to_float(uint16_t half) noexcept
+    {
+        const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16u;
+        const uint32_t exponent = (half >> 10u) & 0x1fu;
+        const uint32_t mantissa = half & 0x3ffu;
+        if (exponent == 0u)
+        {
+            const float value = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -value : value;
+        }
+        if (exponent == 31u)
+            return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13u));
+        return std::bit_cast<float>(sign | ((exponent + 112u) << 23u) | (mantissa << 13u));
+    }
+
+    class MeshCache
+    {
+        MappedFile _file;
+        // Holds the cache instead of the mapping when it could not be written to disk.
+        std::vector<std::byte> _image;
+        const std::byte *_data = nullptr;
+        const MeshCacheHeader *_header = nullptr;
+
+        template <typename T>
+        [[nodiscard]] const T *as(uint64_t offset) const noexcept { return reinterpret_cast<const T *>(_data + offset); }
+
+        // Header, sections and strings of a `size` byte image, checked before anything else in it is read: every
+        // section must be aligned and lie inside the image at the size its count implies, and so must every string.
+        [[nodiscard]] static bool valid(const std::byte *data, uint64_t size) noexcept
+        {
+            if (size < sizeof(MeshCacheHeader))
+                return false;
+            const auto &h = *reinterpret_cast<const MeshCacheHeader *>(data);
+            if (std::memcmp(h.magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0 || h.version != mesh_cache_version || h.file_size != size)
+                return false;
+            auto section = [size](uint64_t offset, uint64_t bytes)
+            { return offset % mesh_cache_alignment == 0u && offset <= size && bytes <= size - offset; };
+            const bool quantized = h.flags & mesh_cache_quantized;
+            const uint64_t normal_stride = h.flags & mesh_cache_normals ? (quantized ? 4u : 16u) : 0u;
+            const uint64_t texcoord_stride = h.flags & mesh_cache_texcoords ? (quantized ? 4u : 8u) : 0u;
+            if (!section(h.positions_offset, 16u * uint64_t{h.vertex_count}) ||
+                !section(h.normals_offset, normal_stride * h.vertex_count) ||
+                !section(h.texcoords_offset, texcoord_stride * h.vertex_count) ||
+                !section(h.indices_offset, sizeof(uint32_t) * uint64_t{h.index_count}) ||
+                !section(h.ranges_offset, sizeof(MeshCacheRange) * uint64_t{h.range_count}) ||
+                !section(h.materials_offset, sizeof(MeshCacheMaterial) * uint64_t{h.material_count}) ||
+                !section(h.strings_offset, 0u))
+                return false;
+            const uint64_t strings = size - h.strings_offset;
+            auto string = [strings](MeshCacheString s)
+            { return uint64_t{s.offset} + s.length <= strings; };
+            const auto *ranges = reinterpret_cast<const MeshCacheRange *>(data + h.ranges_offset);
+            for (uint32_t i = 0u; i < h.range_count; ++i)
+            {
+                const auto &r = ranges[i];
+                if (!string(r.name) || uint64_t{r.first_vertex} + r.vertex_count > h.vertex_count ||
+                    uint64_t{r.first_index} + r.index_count > h.index_count)
+                    return false;
+            }
+            const auto *materials = reinterpret_cast<const MeshCacheMaterial *>(data + h.materials_offset);
+            for (uint32_t i = 0u; i < h.material_count; ++i)
+                if (!string(materials[i].name) || !string(materials[i].diffuse_texname))
+                    return false;
+            return true;
+        }
+
+    public:
+        MeshCache() noexcept = default;
+
+        // Maps `cache_path` and checks it against `source_path`. Falsy when missing, of another version, malformed,
+        // or stale.
+        MeshCache(const std::string &cache_path, const std::string &source_path) : _file(cache_path)
+        {
+            if (!_file || !valid(_file.data(), _file.size()))
+                return;
+            const auto *header = _file.as<MeshCacheHeader>();
+            std::error_code error;
+            const auto source_size = std::filesystem::file_size(source_path, error);
+            if (error || source_size != header->source_size)
+                return;
+            if (const auto mtime = file_mtime(source_path); header->source_mtime != mtime)
+            {
+                if (header->source_hash != hash_file(source_path))
+                    return;
+                // Same contents under a new mtime (touch, copy, checkout): record it so the next open skips the hash.
+                // Best effort; a cache that cannot be written is still valid, only slower to open.
+                std::fstream file(cache_path, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(static_cast<std::streamoff>(offsetof(MeshCacheHeader, source_mtime)));
+                file.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+            }
+            _data = _file.data();
+            _header = header;
+        }
+
+        // Serves an image built by build() from memory.
+        explicit MeshCache(std::vector<std::byte> image) : _image(std::move(image))
+        {
+            if (!valid(_image.data(), _image.size()))
+                return;
+            _data = _image.data();
+            _header = as<MeshCacheHeader>(0u);
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept { return _header != nullptr; }
+        [[nodiscard]] const MeshCacheHeader &header() const noexcept { return *_header; }
+        [[nodiscard]] bool quantized() const noexcept { return _header->flags & mesh_cache_quantized; }
+        [[nodiscard]] bool has_normals() const noexcept { return _header->flags & mesh_cache_normals; }
+        [[nodiscard]] bool has_texcoords() const noexcept { return _header->flags & mesh_cache_texcoords; }
+
+        // Four floats per vertex, ready for a float3 device buffer.
+        [[nodiscard]] const float *positions() const noexcept { return as<float>(_header->positions_offset); }
+        [[nodiscard]] const std::byte *normals() const noexcept { return _data + _header->normals_offset; }
+        [[nodiscard]] const std::byte *texcoords() const noexcept { return _data + _header->texcoords_offset; }
+        [[nodiscard]] const uint32_t *indices() const noexcept { return as<uint32_t>(_header->indices_offset); }
+        [[nodiscard]] const MeshCacheRange *ranges() const noexcept { return as<MeshCacheRange>(_header->ranges_offset); }
+        [[nodiscard]] const MeshCacheMaterial *materials() const noexcept { return as<MeshCacheMaterial>(_header->materials_offset); }
+
+        [[nodiscard]] std::string_view string(MeshCacheString s) const noexcept
+        {
+            return {as<char>(_header->strings_offset + s.offset), s.length};
+        }
+
+        // Decodes one vertex; the device path reads the streams directly instead.
+        [[nodiscard]] MeshVertex vertex(uint32_t i) const noexcept
+        {
+            MeshVertex v{};
+            std::memcpy(v.position, positions() + 4u * i, sizeof(v.position));
+            if (has_normals())
+            {
+                if (quantized())
+                    decode_octahedral(reinterpret_cast<const int16_t *>(normals()) + 2u * i, v.normal);
+                else
+                    std::memcpy(v.normal, reinterpret_cast<const float *>(normals()) + 4u * i, sizeof(v.normal));
+            }
+            if (has_texcoords())
+            {
+                if (quantized())
+                {
+                    const auto *uv = reinterpret_cast<const uint16_t *>(texcoords()) + 2u * i;
+                    v.texcoord[0] = half_to_float(uv[0]);
+                    v.texcoord[1] = half_to_float(uv[1]);
+                }
+                else
+                    std::memcpy(v.texcoord, reinterpret_cast<const float *>(texcoords()) + 2u * i, sizeof(v.texcoord));
+            }
+            return v;
+        }
+
+        // Lays out the cache image for `data` loaded from `source_path`.
+        [[nodiscard]] static std::vector<std::byte> build(const std::string &source_path, const MeshData &data, bool quantize)
+        {
+            const auto vertex_count = static_cast<uint32_t>(data.vertices.size());
+            auto any = [&](auto member)
+            {
+                return std::any_of(data.vertices.begin(), data.vertices.end(), [&](const MeshVertex &v)
+                                   { return std::any_of(std::begin(v.*member), std::end(v.*member), [](float f)
+                                                        { return f != 0.0f; }); });
+            };
+            MeshCacheHeader header{};
+            std::memcpy(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic));
+            header.version = mesh_cache_version;
+            header.flags = (any(&MeshVertex::normal) ? mesh_cache_normals : 0u) |
+                           (any(&MeshVertex::texcoord) ? mesh_cache_texcoords : 0u) |
+                           (quantize ? mesh_cache_quantized : 0u);
+            header.source_size = std::filesystem::file_size(source_path);
+            header.source_mtime = file_mtime(source_path);
+            header.source_hash = hash_file(source_path);
+            header.vertex_count = vertex_count;
+            header.index_count = static_cast<uint32_t>(data.indices.size());
+            header.range_count = static_cast<uint32_t>(data.ranges.size());
+            header.material_count = static_cast<uint32_t>(data.materials.size());
+
+            std::string strings;
+            auto add_string = [&strings](const std::string &s)
+            {
+                MeshCacheString ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+                strings += s;
+                return ref;
+            };
+            std::vector<MeshCacheRange> ranges;
+            ranges.reserve(data.ranges.size());
+            for (const auto &r : data.ranges)
+                ranges.push_back({add_string(r.name), r.material_id, r.first_vertex, r.vertex_count, r.first_index, r.index_count, 0u});
+            std::vector<MeshCacheMaterial> materials;
+            materials.reserve(data.materials.size());
+            for (const auto &m : data.materials)
+            {
+                MeshCacheMaterial &c = materials.emplace_back();
+                c.name = add_string(m.name);
+                c.diffuse_texname = add_string(m.diffuse_texname);
+                for (int k = 0; k < 3; ++k)
+                {
+                    c.ambient[k] = static_cast<float>(m.ambient[k]);
+                    c.diffuse[k] = static_cast<float>(m.diffuse[k]);
+                    c.specular[k] = static_cast<float>(m.specular[k]);
+                    c.transmittance[k] = static_cast<float>(m.transmittance[k]);
+                    c.emission[k] = static_cast<float>(m.emission[k]);
+                }
+                c.shininess = static_cast<float>(m.shininess);
+                c.ior = static_cast<float>(m.ior);
+                c.dissolve = static_cast<float>(m.dissolve);
+                c.illum = m.illum;
+            }
+
+            const size_t normal_stride = header.flags & mesh_cache_normals ? (quantize ? 4u : 16u) : 0u;
+            const size_t texcoord_stride = header.flags & mesh_cache_texcoords ? (quantize ? 4u : 8u) : 0u;
+            uint64_t offset = 0u;
+            auto place = [&offset](size_t bytes)
+            {
+                offset = (offset + mesh_cache_alignment - 1u) / mesh_cache_alignment * mesh_cache_alignment;
+                const auto start = offset;
+                offset += bytes;
+                return start;
+            };
+            place(sizeof(MeshCacheHeader));
+            header.positions_offset = place(16u * static_cast<size_t>(vertex_count));
+            header.normals_offset = place(normal_stride * vertex_count);
+            header.texcoords_offset = place(texcoord_stride * vertex_count);
+            header.indices_offset = place(sizeof(uint32_t) * data.indices.size());
+            header.ranges_offset = place(sizeof(MeshCacheRange) * ranges.size());
+            header.materials_offset = place(sizeof(MeshCacheMaterial) * materials.size());
+            header.strings_offset = place(strings.size());
+            header.file_size = offset;
+
+            std::vector<std::byte> image(offset);
+            auto copy = [&image](uint64_t at, const void *src, size_t bytes)
+            {
+                if (bytes != 0u)
+                    std::memcpy(image.data() + at, src, bytes);
+            };
+            copy(0u, &header, sizeof(header));
+#pragma omp parallel for
+            for (int64_t i = 0; i < static_cast<int64_t>(vertex_count); ++i)
+            {
+                const auto &v = data.vertices[i];
+                const float position[4] = {v.position[0], v.position[1], v.position[2], 1.0f};
+                copy(header.positions_offset + 16u * i, position, sizeof(position));
+                if (normal_stride == 4u)
+                {
+                    int16_t n[2];
+                    encode_octahedral(v.normal, n);
+                    copy(header.normals_offset + 4u * i, n, sizeof(n));
+                }
+                else if (normal_stride == 16u)
+                {
+                    const float n[4] = {v.normal[0], v.normal[1], v.normal[2], 0.0f};
+                    copy(header.normals_offset + 16u * i, n, sizeof(n));
+                }
+                if (texcoord_stride == 4u)
+                {
+                    const uint16_t uv[2] = {float_to_half(v.texcoord[0]), float_to_half(v.texcoord[1])};
+                    copy(header.texcoords_offset + 4u * i, uv, sizeof(uv));
+                }
+                else if (texcoord_stride == 8u)
+                    copy(header.texcoords_offset + 8u * i, v.texcoord, sizeof(v.texcoord));
+            }
+            copy(header.indices_offset, data.indices.data(), sizeof(uint32_t) * data.indices.size());
+            copy(header.ranges_offset, ranges.data(), sizeof(MeshCacheRange) * ranges.size());
+            copy(header.materials_offset, materials.data(), sizeof(MeshCacheMaterial) * materials.size());
+            copy(header.strings_offset, strings.data(), strings.size());
+            return image;
+        }
+
+        // Writes `image` to `cache_path` through a temporary file and a rename, so a crash never leaves a truncated
+        // cache behind. Reports and returns false when either step fails, leaving no temporary file.
+        static bool write(const std::string &cache_path, const std::vector<std::byte> &image)
+        {
+            const auto temporary = cache_path + ".tmp";
+            std::error_code error;
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+            file.close();
+            if (!file)
+            {
+                std::cerr << "Cannot write mesh cache " << temporary << ".\n";
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+            std::filesystem::rename(temporary, cache_path, error);
+            if (error)
+            {
+                std::cerr << "Cannot rename " << temporary << " to " << cache_path << ": " << error.message() << ".\n";
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // Opens "<path>.lctmesh", rebuilding it from the OBJ first when it is missing, malformed, stale, or quantized
+    // differently from what is asked for. A rebuilt cache that cannot be written or mapped back is served from
+    // memory instead.
+    inline MeshCache load_mesh_cache(const std::string &path, bool quantize = false)
+    {
+        const auto cache_path = path + ".lctmesh";
+        MeshCache cache(cache_path, path);
+        if (cache && cache.quantized() == quantize)
+            return cache;
+        cache = MeshCache();
+        auto image = MeshCache::build(path, load_obj(path), quantize);
+        if (MeshCache::write(cache_path, image))
+        {
+            MeshCache written(cache_path, path);
+            if (written)
+                return written;
+        }
+        return MeshCache(std::move(image));
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace lct
+{
+    struct MeshVertex
+    {
+        float position[3];
+        float normal[3];
+        float texcoord[2];
+    };
+
+    // The faces of one shape that use one material. Indices are relative to first_vertex, so a range can be
+    // uploaded as a mesh of its own.
+    struct MeshRange
+    {
+        std::string name;
+        int material_id;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
+    struct MeshData
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshRange> ranges;
+        std::vector<tinyobj::material_t> materials;
+    };
+
+    // Open-addressing table from an OBJ (v, n, t) index triple to the vertex it was assigned. It starts small and
+    // doubles at half load, so its size follows the distinct corners of a range rather than its corner count, and
+    // is never sized beyond max_distinct, the most distinct triples the attribute counts allow.
+    class VertexDedup
+    {
+        struct Slot
+        {
+            int vertex_index;
+            int normal_index;
+            int texcoord_index;
+            uint32_t vertex;
+        };
+        std::vector<Slot> _slots;
+        uint32_t _mask = 0u;
+        size_t _size = 0u;
+
+        [[nodiscard]] static uint32_t hash(int vertex_index, int normal_index, int texcoord_index) noexcept
+        {
+            uint64_t h = static_cast<uint32_t>(vertex_index) * 0x9e3779b97f4a7c15ull;
+            h ^= (static_cast<uint32_t>(normal_index) + 0x632be59bd9b4e019ull + (h << 6u) + (h >> 2u));
+            h ^= (static_cast<uint32_t>(texcoord_index) + 0x8cb92ba72f3d8dd7ull + (h << 6u) + (h >> 2u));
+            return static_cast<uint32_t>(h ^ (h >> 32u));
+        }
+
+        void allocate(size_t distinct)
+        {
+            size_t capacity = 16u;
+            while (capacity < distinct * 2u)
+                capacity *= 2u;
+            _slots.assign(capacity, Slot{-1, 0, 0, 0u});
+            _mask = static_cast<uint32_t>(capacity - 1u);
+        }
+
+        void grow()
+        {
+            auto slots = std::move(_slots);
+            allocate(slots.size());
+            for (const auto &slot : slots)
+            {
+                if (slot.vertex_index < 0)
+                    continue;
+                auto i = hash(slot.vertex_index, slot.normal_index, slot.texcoord_index) & _mask;
+                while (_slots[i].vertex_index >= 0)
+                    i = (i + 1u) & _mask;
+                _slots[i] = slot;
+            }
+        }
+
+    public:
+        explicit VertexDedup(size_t max_distinct) { allocate(std::min<size_t>(max_distinct, 4096u)); }
+
+        // Returns the vertex of `key`, assigning `next` if the triple has not been seen yet.
+        uint32_t find_or_insert(const tinyobj::index_t &key, uint32_t next)
+        {
+            for (auto i = hash(key.vertex_index, key.normal_index, key.texcoord_index) & _mask;; i = (i + 1u) & _mask)
+            {
+                auto &slot = _slots[i];
+                if (slot.vertex_index < 0)
+                {
+                    slot = {key.vertex_index, key.normal_index, key.texcoord_index, next};
+                    if (++_size * 2u > _slots.size())
+                        grow();
+                    return next;
+                }
+                if (slot.vertex_index == key.vertex_index && slot.normal_index == key.normal_index && slot.texcoord_index == key.texcoord_index)
+                    return slot.vertex;
+            }
+        }
+    };
+
+    // Loads a triangulated OBJ into flat vertex and index arrays, one MeshRange per (shape, material) pair.
+    // - Faces are bucketed by material with a counting sort per shape.
+    // - Each range dedups its (v, n, t) corners with a VertexDedup.
+    // - Ranges are processed in parallel and write straight into the preallocated arrays: index offsets follow
+    //   from the face counts, and vertex offsets from a prefix sum over the per-range vertex counts.
+    inline MeshData load_obj(const std::string &path)
+    {
+        tinyobj::ObjReaderConfig config;
+        config.triangulate = true;
+        tinyobj::ObjReader reader;
+        if (!reader.ParseFromFile(path, config))
+        {
+            if (!reader.Error().empty())
+                std::cerr << "TinyObjReader: " << reader.Error();
+            exit(1);
+        }
+        if (!reader.Warning().empty())
+            std::cout << "TinyObjReader: " << reader.Warning();
+
+        const auto &attrib = reader.GetAttrib();
+        const auto &shapes = reader.GetShapes();
+        MeshData data;
+        data.materials = reader.GetMaterials();
+
+        // Bucket the faces of every shape by material. Slot 0 holds the faces without a material, including those whose
+        // id is out of range, and slot m + 1 those of material m.
+        struct Group
+        {
+            uint32_t shape;
+            int material_id;
+            std::vector<uint32_t> faces;
+        };
+        std::vector<std::vector<Group>> shape_groups(shapes.size());
+        const int material_slots = static_cast<int>(data.materials.size()) + 1;
+        auto material_slot = [material_slots](int id)
+        { return id >= 0 && id < material_slots - 1 ? id + 1 : 0; };
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t s = 0; s < static_cast<int64_t>(shapes.size()); ++s)
+        {
+            const auto &mesh = shapes[s].mesh;
+            // Faces past the end of material_ids have no material; counts and groups agree on every face.
+            const auto face_count = static_cast<uint32_t>(mesh.num_face_vertices.size());
+            auto face_slot = [&](uint32_t f)
+            { return material_slot(f < mesh.material_ids.size() ? mesh.material_ids[f] : -1); };
+            std::vector<uint32_t> counts(material_slots, 0u);
+            for (uint32_t f = 0u; f < face_count; ++f)
+                ++counts[face_slot(f)];
+            std::vector<int> slot_group(material_slots, -1);
+            auto &groups = shape_groups[s];
+            for (int m = 0; m < material_slots; ++m)
+            {
+                if (counts[m] == 0u)
+                    continue;
+                slot_group[m] = static_cast<int>(groups.size());
+                groups.push_back({static_cast<uint32_t>(s), m - 1, {}});
+                groups.back().faces.reserve(counts[m]);
+            }
+            for (uint32_t f = 0u; f < face_count; ++f)
+                groups[slot_group[face_slot(f)]].faces.push_back(f);
+        }
+        std::vector<Group> groups;
+        for (auto &g : shape_groups)
+            std::move(g.begin(), g.end(), std::back_inserter(groups));
+
+        data.ranges.resize(groups.size());
+        uint32_t index_count = 0u;
+        for (size_t g = 0u; g < groups.size(); ++g)
+        {
+            data.ranges[g] = {shapes[groups[g].shape].name, groups[g].material_id, 0u, 0u, index_count, static_cast<uint32_t>(groups[g].faces.size() * 3u)};
+            index_count += data.ranges[g].index_count;
+        }
+        data.indices.resize(index_count);
+
+        // Dedup: indices go straight to their final place, the unique corners of each range are kept for the second pass.
+        std::vector<std::vector<tinyobj::index_t>> unique_corners(groups.size());
+        // A range has at most as many distinct corners as (v, n, t) combinations, which without normals and texture
+        // coordinates is just the position count.
+        auto distinct_bound = [&attrib](size_t corners)
+        {
+            size_t bound = attrib.vertices.size() / 3u;
+            for (size_t count : {attrib.normals.size() / 3u + 1u, attrib.texcoords.size() / 2u + 1u})
+                bound = bound > corners / count ? corners : bound * count;
+            return std::min(bound, corners);
+        };
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t g = 0; g < static_cast<int64_t>(groups.size()); ++g)
+        {
+            const auto &group = groups[g];
+            const auto &mesh = shapes[group.shape].mesh;
+            auto &range = data.ranges[g];
+            auto &corners = unique_corners[g];
+            VertexDedup dedup(distinct_bound(range.index_count));
+            uint32_t *out = data.indices.data() + range.first_index;
+            for (auto f : group.faces)
+            {
+                for (uint32_t c = 0u; c < 3u; ++c)
+                {
+                    const auto &key = mesh.indices[static_cast<size_t>(f) * 3u + c];
+                    const auto next = static_cast<uint32_t>(corners.size());
+                    const auto vertex = dedup.find_or_insert(key, next);
+                    if (vertex == next)
+                        corners.push_back(key);
+                    *out++ = vertex;
+                }
+            }
+            range.vertex_count = static_cast<uint32_t>(corners.size());
+        }
+
+        uint32_t vertex_count = 0u;
+        for (auto &range : data.ranges)
+        {
+            range.first_vertex = vertex_count;
+            vertex_count += range.vertex_count;
+        }
+        data.vertices.resize(vertex_count);
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t g = 0; g < static_cast<int64_t>(groups.size()); ++g)
+        {
+            MeshVertex *out = data.vertices.data() + data.ranges[g].first_vertex;
+            for (const auto &key : unique_corners[g])
+            {
+                auto &v = *out++;
+                for (int k = 0; k < 3; ++k)
+                {
+                    v.position[k] = attrib.vertices[3u * key.vertex_index + k];
+                    v.normal[k] = key.normal_index >= 0 ? attrib.normals[3u * key.normal_index + k] : 0.0f;
+                }
+                for (int k = 0; k < 2; ++k)
+                    v.texcoord[k] = key.texcoord_index >= 0 ? attrib.texcoords[2u * key.texcoord_index + k] : 0.0f;
+            }
+        }
+        return data;
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace lct
+{
+    // Accumulation film of a progressive renderer, split into square tiles that are sampled adaptively.
+    // - Every pixel accumulates (r, g, b, luminance^2) sums, laid out like a float4 buffer so a device renderer can
+    //   accumulate in place and download into accumulators(). All pixels of a tile have the same sample count.
+    // - A tile's error is the RMS standard error of its pixel luminance means, relative to the tile's mean
+    //   luminance (plus a small floor so black tiles converge).
+    // - plan() gives every tile min_samples first. After that a tile with error e and n samples needs about
+    //   n * ((e / target)^2 - 1) more samples; it gets that many, at most doubling per pass, until it is under the
+    //   target or reaches max_samples. Converged tiles drop out of later passes.
+    // The sums are always a valid estimate, so resolve() can be called between any two passes.
+    class ProgressiveFilm
+    {
+    public:
+        static constexpr uint32_t tile_size = 16u;
+
+        struct Options
+        {
+            uint32_t min_samples = 4u;
+            uint32_t max_samples = 1024u;
+            float target_error = 0.02f;
+        };
+
+        struct Tile
+        {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+            uint32_t height;
+            uint32_t samples;
+            float error;
+            bool converged;
+        };
+
+        // `samples` new samples of `tile`, numbered from `first_sample`.
+        struct Work
+        {
+            uint32_t tile;
+            uint32_t first_sample;
+            uint32_t samples;
+        };
+
+    private:
+        uint32_t _width;
+        uint32_t _height;
+        Options _options;
+        std::vector<float> _accumulators;
+        std::vector<Tile> _tiles;
+        uint64_t _total_samples = 0u;
+        uint32_t _passes = 0u;
+
+        static float luminance(const float *rgb) noexcept { return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2]; }
+
+        [[nodiscard]] float tile_error(const Tile &tile) const noexcept
+        {
+            const float n = static_cast<float>(tile.samples);
+            double variance_of_mean = 0.0;
+            double mean = 0.0;
+            for (uint32_t y = tile.y; y < tile.y + tile.height; ++y)
+            {
+                for (uint32_t x = tile.x; x < tile.x + tile.width; ++x)
+                {
+                    const float *a = pixel(x, y);
+                    const float m = luminance(a) / n;
+                    const float variance = std::max(a[3] / n - m * m, 0.0f) * n / std::max(n - 1.0f, 1.0f);
+                    variance_of_mean += variance / n;
+                    mean += m;
+                }
+            }
+            const double pixels = static_cast<double>(tile.width) * tile.height;
+            return static_cast<float>(std::sqrt(variance_of_mean / pixels) / (mean / pixels + 0.05));
+        }
+
+    public:
+        ProgressiveFilm(uint32_t width, uint32_t height, Options options)
+            : _width(width), _height(height), _options(options), _accumulators(static_cast<size_t>(width) * height * 4u, 0.0f)
+        {
+            _options.min_samples = std::max(_options.min_samples, 2u);
+            _options.max_samples = std::max(_options.max_samples, _options.min_samples);
+            for (uint32_t y = 0u; y < height; y += tile_size)
+                for (uint32_t x = 0u; x < width; x += tile_size)
+                    _tiles.push_back({x, y, std::min(tile_size, width - x), std::min(tile_size, height - y), 0u, 0.0f, false});
+        }
+
+        [[nodiscard]] uint32_t width() const noexcept { return _width; }
+        [[nodiscard]] uint32_t height() const noexcept { return _height; }
+        [[nodiscard]] uint32_t tiles_x() const noexcept { return (_width + tile_size - 1u) / tile_size; }
+        [[nodiscard]] const std::vector<Tile> &tiles() const noexcept { return _tiles; }
+        [[nodiscard]] uint64_t total_samples() const noexcept { return _total_samples; }
+        [[nodiscard]] uint32_t passes() const noexcept { return _passes; }
+        [[nodiscard]] float *accumulators() noexcept { return _accumulators.data(); }
+        [[nodiscard]] float *pixel(uint32_t x, uint32_t y) noexcept { return _accumulators.data() + (static_cast<size_t>(y) * _width + x) * 4u; }
+        [[nodiscard]] const float *pixel(uint32_t x, uint32_t y) const noexcept { return _accumulators.data() + (static_cast<size_t>(y) * _width + x) * 4u; }
+
+        // Adds one sample to a pixel. Tiles are rendered by one thread each, so no synchronization is needed.
+        void add(uint32_t x, uint32_t y, const float rgb[3]) noexcept
+        {
+            float *a = pixel(x, y);
+            a[0] += rgb[0];
+            a[1] += rgb[1];
+            a[2] += rgb[2];
+            const float l = luminance(rgb);
+            a[3] += l * l;
+        }
+
+        // The samples of the next pass, most samples first, so the longest tiles start early. Empty when done.
+        [[nodiscard]] std::vector<Work> plan() const
+        {
+            std::vector<Work> work;
+            for (uint32_t t = 0u; t < _tiles.size(); ++t)
+            {
+                const auto &tile = _tiles[t];
+                if (tile.converged)
+                    continue;
+                uint32_t samples = _options.min_samples;
+                if (tile.samples > 0u)
+                {
+                    const float ratio = tile.error / _options.target_error;
+                    const float needed = static_cast<float>(tile.samples) * (ratio * ratio - 1.0f);
+                    samples = static_cast<uint32_t>(std::clamp(std::ceil(needed), 1.0f, static_cast<float>(tile.samples)));
+                }
+                samples = std::min(samples, _options.max_samples - tile.samples);
+                work.push_back({t, tile.samples, samples});
+            }
+            std::stable_sort(work.begin(), work.end(), [](const Work &a, const Work &b)
+                             { return a.samples > b.samples; });
+            return work;
+        }
+
+        // Records a rendered pass and updates the errors of its tiles.
+        void commit(const std::vector<Work> &work)
+        {
+#pragma omp parallel for schedule(dynamic, 16)
+            for (int64_t i = 0; i < static_cast<int64_t>(work.size()); ++i)
+            {
+                auto &tile = _tiles[work[i].tile];
+                tile.samples += work[i].samples;
+                tile.error = tile_error(tile);
+                tile.converged = tile.samples >= _options.max_samples ||
+                                 (tile.samples >= _options.min_samples && tile.error <= _options.target_error);
+            }
+            for (const auto &w : work)
+                _total_samples += static_cast<uint64_t>(w.samples) * _tiles[w.tile].width * _tiles[w.tile].height;
+            ++_passes;
+        }
+
+        // Mean of every pixel, gamma encoded into RGBA8.
+        void resolve(std::vector<unsigned char> &rgba) const
+        {
+            rgba.resize(static_cast<size_t>(_width) * _height * 4u);
+#pragma omp parallel for
+            for (int64_t t = 0; t < static_cast<int64_t>(_tiles.size()); ++t)
+            {
+                const auto &tile = _tiles[t];
+                const float scale = tile.samples > 0u ? 1.0f / static_cast<float>(tile.samples) : 0.0f;
+                for (uint32_t y = tile.y; y < tile.y + tile.height; ++y)
+                {
+                    for (uint32_t x = tile.x; x < tile.x + tile.width; ++x)
+                    {
+                        const float *a = pixel(x, y);
+                        auto *out = rgba.data() + (static_cast<size_t>(y) * _width + x) * 4u;
+                        for (int k = 0; k < 3; ++k)
+                            out[k] = static_cast<unsigned char>(255.0f * std::pow(std::clamp(a[k] * scale, 0.0f, 1.0f), 1.0f / 2.2f) + 0.5f);
+                        out[3] = 255u;
+                    }
+                }
+            }
+        }
+    };
+}
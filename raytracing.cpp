@@ -1,90 +1,662 @@
 #include <luisa-compute.h>
-#include <lodepng.h>
-#include <tiny_obj_loader.h>
+#include <backend.h>
+#include <bvh.h>
+#include <imageio.h>
+#include <meshcache.h>
+#include <progressive.h>
+#include <shadercache.h>
+#include <workqueue.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iomanip>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <numeric>
+#include <string>
 #include <vector>
-#include <set>
 
 using namespace luisa::compute;
 
-struct Compare
-{
-    inline bool operator()(const tinyobj::index_t &a,
-                           const tinyobj::index_t &b)
-    {
-        if (a.vertex_index < b.vertex_index)
-            return true;
-        if (a.vertex_index > b.vertex_index)
-            return false;
+// rttest <scene.obj> [--quantize] [--cpu] [--size <pixels>] [--render [--max-spp <n>] [--target-error <e>] [--preview-ms <ms>]]
+// rttest --precompile
+//
+// The OBJ is parsed once into "<scene.obj>.lctmesh"; later runs map that cache. The scene goes into a device Accel,
+// and with --cpu or LCT_BACKEND=host (which skips the device) into an lct::Bvh.
+// - Without --render, the Bvh is validated and benchmarked, and its primary hits are written to rttest_cpu.png.
+// - With --render, the scene is rendered progressively with sky-lit ambient occlusion into rttest_render.png, which
+//   is rewritten with the current estimate every preview interval. Tiles are sampled adaptively (see
+//   lct::ProgressiveFilm); on the CPU they run on a work-stealing pool, on the device as one wavefront dispatch per
+//   sample count.
 
-        if (a.normal_index < b.normal_index)
-            return true;
-        if (a.normal_index > b.normal_index)
-            return false;
+uint32_t mix_bits(uint32_t x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
 
-        if (a.texcoord_index < b.texcoord_index)
-            return true;
-        if (a.texcoord_index > b.texcoord_index)
-            return false;
+float next_random(uint32_t &state)
+{
+    state = mix_bits(state);
+    return static_cast<float>(state >> 8u) * 0x1p-24f;
+}
 
-        return false;
+std::vector<lct::BvhTriangle> bvh_triangles(const lct::MeshCache &scene)
+{
+    std::vector<lct::BvhTriangle> triangles(scene.header().index_count / 3u);
+    const float *positions = scene.positions();
+    for (uint r = 0u; r < scene.header().range_count; ++r)
+    {
+        const auto &range = scene.ranges()[r];
+        const uint32_t *indices = scene.indices() + range.first_index;
+#pragma omp parallel for
+        for (int64_t t = 0; t < static_cast<int64_t>(range.index_count / 3u); ++t)
+        {
+            const float *p[3];
+            for (int c = 0; c < 3; ++c)
+                p[c] = positions + 4u * (range.first_vertex + indices[3u * t + c]);
+            auto &tri = triangles[range.first_index / 3u + t];
+            for (int k = 0; k < 3; ++k)
+            {
+                tri.v0[k] = p[0][k];
+                tri.e1[k] = p[1][k] - p[0][k];
+                tri.e2[k] = p[2][k] - p[0][k];
+            }
+            tri.prim = static_cast<uint32_t>(range.first_index / 3u + t);
+        }
     }
+    return triangles;
+}
+
+// Pinhole camera looking down -z at the whole scene.
+struct Camera
+{
+    float eye[3];
+    float tan_half_fov;
+    float radius;
 };
 
-auto loadObj(const std::string &path)
+Camera frame_scene(const lct::MeshCache &scene)
 {
-    tinyobj::ObjReader reader;
-    if (!reader.ParseFromFile(path))
+    float lo[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float hi[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (uint32_t i = 0u; i < scene.header().vertex_count; ++i)
     {
-        if (!reader.Error().empty())
+        for (int k = 0; k < 3; ++k)
         {
-            std::cerr << "TinyObjReader: " << reader.Error();
+            lo[k] = std::min(lo[k], scene.positions()[4u * i + k]);
+            hi[k] = std::max(hi[k], scene.positions()[4u * i + k]);
         }
-        exit(1);
     }
+    const float radius = 0.5f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+    return {{0.5f * (lo[0] + hi[0]), 0.5f * (lo[1] + hi[1]), 0.5f * (lo[2] + hi[2]) + 2.5f * radius}, std::tan(0.35f), radius};
+}
+
+// Primary rays ordered as 4x2 pixel tiles, so that every group of eight rays is a coherent packet.
+std::vector<lct::BvhRay> primary_rays(const Camera &camera, uint size)
+{
+    const auto &eye = camera.eye;
+    const float tan_half_fov = camera.tan_half_fov;
+    std::vector<lct::BvhRay> rays(static_cast<size_t>(size) * size);
+#pragma omp parallel for
+    for (int64_t i = 0; i < static_cast<int64_t>(rays.size()); ++i)
+    {
+        const auto tile = static_cast<uint>(i / 8);
+        const auto x = tile % (size / 4u) * 4u + static_cast<uint>(i % 4);
+        const auto y = tile / (size / 4u) * 2u + static_cast<uint>(i % 8 / 4);
+        float d[3] = {(2.0f * (x + 0.5f) / size - 1.0f) * tan_half_fov, (1.0f - 2.0f * (y + 0.5f) / size) * tan_half_fov, -1.0f};
+        const float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        rays[i] = {{eye[0], eye[1], eye[2]}, 0.0f, {d[0] / length, d[1] / length, d[2] / length}, std::numeric_limits<float>::infinity()};
+    }
+    return rays;
+}
+
+// Pixel of primary ray `i`.
+uint2 tile_pixel(size_t i, uint size)
+{
+    const auto tile = static_cast<uint>(i / 8u);
+    return make_uint2(tile % (size / 4u) * 4u + static_cast<uint>(i % 4u), tile / (size / 4u) * 2u + static_cast<uint>(i % 8u / 4u));
+}
+
+// One bounce: uniformly random directions from the primary hit points, or from random points in the scene bounds
+// where the primary ray missed.
+std::vector<lct::BvhRay> incoherent_rays(const lct::Bvh &bvh, const std::vector<lct::BvhRay> &primary, const std::vector<lct::BvhHit> &hits)
+{
+    const float *lo = bvh.bounds_min();
+    const float *hi = bvh.bounds_max();
+    const float epsilon = 1e-4f * std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+    std::vector<lct::BvhRay> rays(primary.size());
+#pragma omp parallel for
+    for (int64_t i = 0; i < static_cast<int64_t>(rays.size()); ++i)
+    {
+        auto state = static_cast<uint32_t>(i) * 0x9e3779b9u + 1u;
+        auto &ray = rays[i];
+        for (int k = 0; k < 3; ++k)
+            ray.origin[k] = hits[i].prim != lct::bvh_miss ? primary[i].origin[k] + hits[i].t * primary[i].direction[k]
+                                                          : lo[k] + next_random(state) * (hi[k] - lo[k]);
+        const float z = 1.0f - 2.0f * next_random(state);
+        const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        const float phi = 6.2831853f * next_random(state);
+        ray.direction[0] = r * std::cos(phi);
+        ray.direction[1] = r * std::sin(phi);
+        ray.direction[2] = z;
+        ray.tmin = epsilon;
+        ray.tmax = std::numeric_limits<float>::infinity();
+    }
+    return rays;
+}
+
+void trace_single(const lct::Bvh &bvh, const std::vector<lct::BvhRay> &rays, std::vector<lct::BvhHit> &hits)
+{
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int64_t i = 0; i < static_cast<int64_t>(rays.size()); ++i)
+        hits[i] = bvh.intersect(rays[i]);
+}
+
+void trace_packets(const lct::Bvh &bvh, const std::vector<lct::BvhRay> &rays, std::vector<lct::BvhHit> &hits)
+{
+#pragma omp parallel for schedule(dynamic, 32)
+    for (int64_t p = 0; p < static_cast<int64_t>(rays.size() / 8u); ++p)
+        bvh.intersect8(rays.data() + 8 * p, hits.data() + 8 * p);
+}
+
+// Best of three runs, in Mrays/s.
+template <typename Trace>
+double measure(const std::vector<lct::BvhRay> &rays, std::vector<lct::BvhHit> &hits, Trace &&trace)
+{
+    double best_ms = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run)
+    {
+        luisa::Clock clock;
+        clock.tic();
+        trace(rays, hits);
+        best_ms = std::min(best_ms, clock.toc());
+    }
+    return static_cast<double>(rays.size()) / (best_ms * 1e3);
+}
 
-    if (!reader.Warning().empty())
+// Packet hits that disagree with single-ray hits beyond the float noise of the shared test.
+size_t count_mismatches(const std::vector<lct::BvhHit> &a, const std::vector<lct::BvhHit> &b)
+{
+    size_t mismatches = 0u;
+    for (size_t i = 0u; i < a.size(); ++i)
     {
-        std::cout << "TinyObjReader: " << reader.Warning();
+        if ((a[i].prim == lct::bvh_miss) != (b[i].prim == lct::bvh_miss))
+            ++mismatches;
+        else if (a[i].prim != lct::bvh_miss && std::abs(a[i].t - b[i].t) > 1e-5f * std::max(a[i].t, 1.0f))
+            ++mismatches;
     }
+    return mismatches;
+}
 
-    auto &attrib = reader.GetAttrib();
-    auto &shapes = reader.GetShapes();
-    auto &materials = reader.GetMaterials();
+// Checks a sample of the traversal hits against testing every triangle; returns the number of disagreements.
+size_t brute_force_mismatches(const lct::Bvh &bvh, const std::vector<lct::BvhRay> &rays, const std::vector<lct::BvhHit> &hits)
+{
+    const auto &triangles = bvh.triangles();
+    const size_t samples = std::clamp<size_t>(200'000'000u / std::max<size_t>(triangles.size(), 1u), 16u, 256u);
+    std::vector<lct::BvhHit> expected(samples), found(samples);
+#pragma omp parallel for
+    for (int64_t s = 0; s < static_cast<int64_t>(samples); ++s)
+    {
+        const auto i = static_cast<size_t>(s) * rays.size() / samples;
+        const auto &ray = rays[i];
+        lct::BvhHit hit{ray.tmax, 0.0f, 0.0f, lct::bvh_miss};
+        for (const auto &tri : triangles)
+            lct::intersect_triangle(tri, ray.origin, ray.direction, ray.tmin, hit.t, hit);
+        expected[s] = hit;
+        found[s] = hits[i];
+    }
+    return count_mismatches(expected, found);
+}
 
-    std::vector<Mesh> ret_mesh = {};
+// Unnormalized geometric normal of triangle `prim` of the cache.
+void geometric_normal(const lct::MeshCache &scene, uint32_t prim, float n[3])
+{
+    const auto *ranges = scene.ranges();
+    const auto first_index = 3u * prim;
+    const auto *range = std::upper_bound(ranges, ranges + scene.header().range_count, first_index, [](uint32_t index, const lct::MeshCacheRange &r)
+                                         { return index < r.first_index; }) -
+                        1;
+    const float *p[3];
+    for (int c = 0; c < 3; ++c)
+        p[c] = scene.positions() + 4u * (range->first_vertex + scene.indices()[first_index + c]);
+    const float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+    const float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
 
-    for (const auto &shape : shapes)
+void save_hits(const std::string &path, const lct::MeshCache &scene, const std::vector<lct::BvhRay> &rays, const std::vector<lct::BvhHit> &hits, uint size)
+{
+    std::vector<unsigned char> image(static_cast<size_t>(size) * size * 4u, 0u);
+#pragma omp parallel for
+    for (int64_t i = 0; i < static_cast<int64_t>(hits.size()); ++i)
     {
-        std::set<int> materialIDs;
-        for(auto faceMatID : shape.mesh.material_ids)
+        const auto pixel = tile_pixel(static_cast<size_t>(i), size);
+        auto *rgba = image.data() + (static_cast<size_t>(pixel.y) * size + pixel.x) * 4u;
+        rgba[3] = 255u;
+        if (hits[i].prim == lct::bvh_miss)
+            continue;
+        // Geometric normal, two-sided, shaded with a headlight.
+        float n[3];
+        geometric_normal(scene, hits[i].prim, n);
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        const auto &d = rays[i].direction;
+        const float shade = length > 0.0f ? std::abs(n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) / length : 0.0f;
+        for (int k = 0; k < 3; ++k)
+            rgba[k] = static_cast<unsigned char>(255.0f * (0.1f + 0.9f * shade) * (0.5f + 0.5f * std::abs(n[k]) / std::max(length, 1e-20f)));
+    }
+    if (auto error = lct::write_image(path, image, size, size))
+        std::cerr << path << ": " << error << "\n";
+}
+
+void benchmark_cpu_bvh(const lct::Bvh &bvh, const lct::MeshCache &scene, const Camera &camera, uint size)
+{
+    const auto primary = primary_rays(camera, size);
+    std::vector<lct::BvhHit> single(primary.size()), packet(primary.size());
+    const double primary_single = measure(primary, single, [&](auto &r, auto &h)
+                                          { trace_single(bvh, r, h); });
+    const double primary_packet = measure(primary, packet, [&](auto &r, auto &h)
+                                          { trace_packets(bvh, r, h); });
+    const auto primary_mismatches = count_mismatches(single, packet);
+    const auto primary_brute = brute_force_mismatches(bvh, primary, single);
+    save_hits("rttest_cpu.png", scene, primary, single, size);
+
+    const auto incoherent = incoherent_rays(bvh, primary, single);
+    const double incoherent_single = measure(incoherent, single, [&](auto &r, auto &h)
+                                             { trace_single(bvh, r, h); });
+    const double incoherent_packet = measure(incoherent, packet, [&](auto &r, auto &h)
+                                             { trace_packets(bvh, r, h); });
+    const auto incoherent_mismatches = count_mismatches(single, packet);
+    const auto incoherent_brute = brute_force_mismatches(bvh, incoherent, single);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "primary    " << size << "x" << size << ": single " << primary_single << " Mrays/s, packet " << primary_packet << " Mrays/s\n"
+              << "incoherent " << size << "x" << size << ": single " << incoherent_single << " Mrays/s, packet " << incoherent_packet << " Mrays/s\n"
+              << std::defaultfloat
+              << "Packet vs single-ray mismatches: " << primary_mismatches << " primary, " << incoherent_mismatches << " incoherent.\n"
+              << "Brute-force mismatches: " << primary_brute << " primary, " << incoherent_brute << " incoherent.\n"
+              << "Primary hits written to rttest_cpu.png.\n";
+}
+
+struct RenderOptions
+{
+    lct::ProgressiveFilm::Options film;
+    double preview_ms = 1000.0;
+    std::string output = "rttest_render.png";
+};
+
+// Runs passes until every tile has converged. Previews are resolved between passes and encoded on another thread
+// while the next pass renders, as fast PNGs so encoding keeps up with short preview intervals; the final image gets
+// the default, smaller encoding.
+template <typename RenderPass>
+void progressive_render(lct::ProgressiveFilm &film, const RenderOptions &options, RenderPass &&render_pass)
+{
+    luisa::Clock clock;
+    clock.tic();
+    std::vector<unsigned char> rgba;
+    std::future<void> encoding;
+    auto write_preview = [&](bool final)
+    {
+        if (encoding.valid())
+            encoding.wait();
+        film.resolve(rgba);
+        encoding = std::async(std::launch::async, [&rgba, &options, &film, final]
+                              {
+                                  if (auto error = lct::write_image(options.output, rgba, film.width(), film.height(), {.fast_png = !final}))
+                                      std::cerr << options.output << ": " << error << "\n";
+                              });
+    };
+    double last_preview = 0.0;
+    for (auto work = film.plan(); !work.empty(); work = film.plan())
+    {
+        render_pass(work);
+        film.commit(work);
+        if (clock.toc() - last_preview >= options.preview_ms)
         {
-            materialIDs.insert(faceMatID);
+            write_preview(false);
+            last_preview = clock.toc();
         }
+    }
+    write_preview(true);
+    encoding.wait();
+    const double ms = clock.toc();
+
+    // Uniform sampling needs the worst tile's sample count everywhere to reach the same noise.
+    uint32_t most = 0u;
+    for (const auto &tile : film.tiles())
+        most = std::max(most, tile.samples);
+    const auto pixels = static_cast<double>(film.width()) * film.height();
+    const auto samples = static_cast<double>(film.total_samples());
+    std::cout << std::fixed << std::setprecision(2) << "Rendered " << film.width() << "x" << film.height() << " in " << ms << " ms, "
+              << film.passes() << " passes: " << samples / pixels << " spp on average, " << most << " at most, "
+              << samples / (ms * 1e3) << " Msamples/s.\n"
+              << "Uniform sampling at " << most << " spp would take " << pixels * most / samples << "x the samples.\n"
+              << std::defaultfloat << "Written to " << options.output << ".\n";
+}
 
-        for(int materialID : materialIDs)
+void sky(const float d[3], float rgb[3])
+{
+    const float t = 0.5f * (d[1] + 1.0f);
+    rgb[0] = (1.0f - t) + t * 0.5f;
+    rgb[1] = (1.0f - t) + t * 0.7f;
+    rgb[2] = 1.0f;
+}
+
+// One sample of sky-lit ambient occlusion: a jittered primary ray, then a cosine-weighted occlusion ray.
+void shade_sample(const lct::Bvh &bvh, const lct::MeshCache &scene, const Camera &camera, uint width, uint height, uint x, uint y, uint sample, float rgb[3])
+{
+    auto state = mix_bits(mix_bits(y * width + x) ^ (sample * 0x9e3779b9u));
+    const float jx = next_random(state);
+    const float jy = next_random(state);
+    float d[3] = {(2.0f * (x + jx) / width - 1.0f) * camera.tan_half_fov, (1.0f - 2.0f * (y + jy) / height) * camera.tan_half_fov, -1.0f};
+    const float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    for (auto &v : d)
+        v /= length;
+    const auto hit = bvh.intersect({{camera.eye[0], camera.eye[1], camera.eye[2]}, 0.0f, {d[0], d[1], d[2]}, std::numeric_limits<float>::infinity()});
+    if (hit.prim == lct::bvh_miss)
+    {
+        sky(d, rgb);
+        return;
+    }
+    float n[3];
+    geometric_normal(scene, hit.prim, n);
+    const float n_length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    const float facing = n[0] * d[0] + n[1] * d[1] + n[2] * d[2] > 0.0f ? -1.0f : 1.0f;
+    for (auto &v : n)
+        v *= facing / std::max(n_length, 1e-20f);
+    // Orthonormal basis around n (Duff et al.).
+    const float sign = std::copysign(1.0f, n[2]);
+    const float a = -1.0f / (sign + n[2]);
+    const float b = n[0] * n[1] * a;
+    const float t[3] = {1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0]};
+    const float bt[3] = {b, sign + n[1] * n[1] * a, -n[1]};
+    const float u1 = next_random(state);
+    const float phi = 6.2831853f * next_random(state);
+    const float r = std::sqrt(u1);
+    const float lx = r * std::cos(phi), ly = r * std::sin(phi), lz = std::sqrt(std::max(1.0f - u1, 0.0f));
+    lct::BvhRay occlusion{};
+    for (int k = 0; k < 3; ++k)
+    {
+        occlusion.direction[k] = lx * t[k] + ly * bt[k] + lz * n[k];
+        occlusion.origin[k] = camera.eye[k] + hit.t * d[k] + 1e-4f * camera.radius * n[k];
+    }
+    occlusion.tmin = 0.0f;
+    occlusion.tmax = 0.5f * camera.radius;
+    if (bvh.occluded(occlusion))
+    {
+        rgb[0] = rgb[1] = rgb[2] = 0.0f;
+        return;
+    }
+    sky(occlusion.direction, rgb);
+    for (int k = 0; k < 3; ++k)
+        rgb[k] *= 0.8f;
+}
+
+void render_cpu(const lct::Bvh &bvh, const lct::MeshCache &scene, const Camera &camera, uint size, const RenderOptions &options)
+{
+    lct::ProgressiveFilm film(size, size, options.film);
+    lct::WorkStealingPool pool;
+    std::atomic<int64_t> busy_ns{0};
+    luisa::Clock clock;
+    clock.tic();
+    progressive_render(film, options, [&](const std::vector<lct::ProgressiveFilm::Work> &work)
+                       {
+        std::vector<uint32_t> tasks(work.size());
+        std::iota(tasks.begin(), tasks.end(), 0u);
+        std::function<void(uint32_t)> body = [&](uint32_t i)
         {
-            std::map<tinyobj::index_t, int, Compare> knownVertices;
-            std::map<std::string, int> knownTextures;
-            Mesh mesh = {};
+            const auto start = std::chrono::steady_clock::now();
+            const auto &w = work[i];
+            const auto &tile = film.tiles()[w.tile];
+            for (uint y = tile.y; y < tile.y + tile.height; ++y)
+            {
+                for (uint x = tile.x; x < tile.x + tile.width; ++x)
+                {
+                    for (uint s = w.first_sample; s < w.first_sample + w.samples; ++s)
+                    {
+                        float rgb[3];
+                        shade_sample(bvh, scene, camera, size, size, x, y, s, rgb);
+                        film.add(x, y, rgb);
+                    }
+                }
+            }
+            busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        };
+        pool.run(tasks, body); });
+    std::cout << "Worker utilization: " << std::fixed << std::setprecision(1)
+              << 100.0 * static_cast<double>(busy_ns.load()) / (clock.toc() * 1e6 * static_cast<double>(pool.size())) << "% of "
+              << pool.size() << " threads.\n"
+              << std::defaultfloat;
+}
 
-            
+// Wavefront version of shade_sample: every dispatch covers the tiles of a pass that take the same number of
+// samples, one thread per pixel. `work` holds (tile, first sample) pairs. With `precompile`, the shader is only
+// recorded in the ahead-of-time bundle.
+auto compile_render_shader(Context &context, Device &device, bool precompile = false)
+{
+    constexpr uint tile_size = lct::ProgressiveFilm::tile_size;
+    lct::ShaderCache cache(context, device, "rttest", precompile);
+    Callable mix = [](UInt x) noexcept
+    {
+        Var h = x ^ (x >> 16u);
+        h = h * 0x7feb352du;
+        h = h ^ (h >> 15u);
+        h = h * 0x846ca68bu;
+        return h ^ (h >> 16u);
+    };
+    Callable sky_color = [](Float3 d) noexcept
+    {
+        Var t = 0.5f * (d.y + 1.0f);
+        return (1.0f - t) * make_float3(1.0f) + t * make_float3(0.5f, 0.7f, 1.0f);
+    };
+    Kernel1D render_kernel = [&](BufferUInt work, UInt offset, AccelVar scene, BindlessVar buffers, BufferFloat4 accumulators, UInt width, UInt height,
+                                 UInt tiles_x, UInt samples, Float3 eye, Float tan_half_fov, Float radius) noexcept
+    {
+        constexpr uint tile_pixels = tile_size * tile_size;
+        Var entry = offset + dispatch_id().x / tile_pixels;
+        Var local = dispatch_id().x % tile_pixels;
+        Var tile = work.read(2u * entry);
+        Var first_sample = work.read(2u * entry + 1u);
+        Var x = tile % tiles_x * tile_size + local % tile_size;
+        Var y = tile / tiles_x * tile_size + local / tile_size;
+        $if(x < width && y < height)
+        {
+            Var pixel = y * width + x;
+            Float4 sum = accumulators.read(pixel);
+            $for(s, samples)
+            {
+                UInt state = mix(mix(pixel) ^ ((first_sample + s) * 0x9e3779b9u));
+                auto next = [&]() noexcept
+                {
+                    state = mix(state);
+                    return cast<float>(state >> 8u) * 0x1p-24f;
+                };
+                Var jx = next();
+                Var jy = next();
+                Var d = normalize(make_float3((2.0f * (cast<float>(x) + jx) / cast<float>(width) - 1.0f) * tan_half_fov,
+                                              (1.0f - 2.0f * (cast<float>(y) + jy) / cast<float>(height)) * tan_half_fov, -1.0f));
+                Var hit = scene.trace_closest(make_ray(eye, d, 0.0f, std::numeric_limits<float>::max()));
+                Float3 color = sky_color(d);
+                $if(!hit->miss())
+                {
+                    Var triangle = buffers.buffer<Triangle>(2u * hit.inst + 1u).read(hit.prim);
+                    Var p0 = buffers.buffer<float3>(2u * hit.inst).read(triangle.i0);
+                    Var p1 = buffers.buffer<float3>(2u * hit.inst).read(triangle.i1);
+                    Var p2 = buffers.buffer<float3>(2u * hit.inst).read(triangle.i2);
+                    Float3 n = normalize(cross(p1 - p0, p2 - p0));
+                    n = ite(dot(n, d) > 0.0f, -n, n);
+                    Var p = p0 + hit.bary.x * (p1 - p0) + hit.bary.y * (p2 - p0) + 1e-4f * radius * n;
+                    Var sign = ite(n.z >= 0.0f, 1.0f, -1.0f);
+                    Var a = -1.0f / (sign + n.z);
+                    Var b = n.x * n.y * a;
+                    Var t = make_float3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+                    Var bt = make_float3(b, sign + n.y * n.y * a, -n.y);
+                    Var u1 = next();
+                    Var phi = 6.2831853f * next();
+                    Var r = sqrt(u1);
+                    Var direction = r * cos(phi) * t + r * sin(phi) * bt + sqrt(max(1.0f - u1, 0.0f)) * n;
+                    Var occluded = scene.trace_any(make_ray(p, direction, 0.0f, 0.5f * radius));
+                    color = ite(occluded, make_float3(0.0f), 0.8f * sky_color(direction));
+                };
+                Var l = dot(color, make_float3(0.2126f, 0.7152f, 0.0722f));
+                sum += make_float4(color, l * l);
+            };
+            accumulators.write(pixel, sum);
+        };
+    };
+    auto render_shader = cache.compile(render_kernel, "render");
+    cache.report();
+    return render_shader;
+}
+
+// Renders with the wavefront shader above. The accumulators live on the device and are downloaded into the film
+// after each pass for the error estimates and previews.
+void render_device(Context &context, Device &device, Stream &stream, Accel &accel, BindlessArray &heap, const Camera &camera, uint size, const RenderOptions &options)
+{
+    constexpr uint tile_size = lct::ProgressiveFilm::tile_size;
+    auto render_shader = compile_render_shader(context, device);
+
+    lct::ProgressiveFilm film(size, size, options.film);
+    Buffer<float4> accumulators = device.create_buffer<float4>(static_cast<size_t>(size) * size);
+    Buffer<uint> work_buffer = device.create_buffer<uint>(2u * film.tiles().size());
+    stream << accumulators.copy_from(film.accumulators()) << synchronize();
+    std::vector<uint> entries;
+    progressive_render(film, options, [&](const std::vector<lct::ProgressiveFilm::Work> &work)
+                       {
+        // Work is sorted by sample count, so every sample count is one contiguous wavefront.
+        entries.clear();
+        for (const auto &w : work)
+        {
+            entries.push_back(w.tile);
+            entries.push_back(w.first_sample);
         }
-    }
+        CommandList commands;
+        commands << work_buffer.view(0u, entries.size()).copy_from(entries.data());
+        for (size_t begin = 0u, end; begin < work.size(); begin = end)
+        {
+            for (end = begin; end < work.size() && work[end].samples == work[begin].samples; ++end)
+                ;
+            commands << render_shader(work_buffer, static_cast<uint>(begin), accel, heap, accumulators, size, size, film.tiles_x(), work[begin].samples,
+                                      make_float3(camera.eye[0], camera.eye[1], camera.eye[2]), camera.tan_half_fov, camera.radius)
+                            .dispatch(static_cast<uint>(end - begin) * tile_size * tile_size);
+        }
+        commands << accumulators.copy_to(film.accumulators());
+        stream << commands.commit() << synchronize(); });
 }
 
-int main(int, char **argv)
+int main(int argc, char **argv)
 {
     Context context{argv[0]};
-    Device device = context.create_device("cuda");
+    std::string scene_path;
+    bool quantize = false;
+    bool cpu = lct::host_backend_requested();
+    bool render = false;
+    bool precompile = false;
+    RenderOptions render_options;
+    uint size = 1024u;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quantize")
+            quantize = true;
+        else if (arg == "--cpu")
+            cpu = true;
+        else if (arg == "--render")
+            render = true;
+        else if (arg == "--precompile")
+            precompile = true;
+        else if (arg == "--size" && i + 1 < argc)
+            size = std::max(8u, static_cast<uint>(std::stoul(argv[++i])) / 8u * 8u);
+        else if (arg == "--max-spp" && i + 1 < argc)
+            render_options.film.max_samples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--target-error" && i + 1 < argc)
+            render_options.film.target_error = std::stof(argv[++i]);
+        else if (arg == "--preview-ms" && i + 1 < argc)
+            render_options.preview_ms = std::stod(argv[++i]);
+        else
+            scene_path = arg;
+    }
+
+    auto run_cpu = [&](const lct::MeshCache &scene)
+    {
+        luisa::Clock clock;
+        clock.tic();
+        lct::Bvh bvh(bvh_triangles(scene));
+        std::cout << "BVH built in " << clock.toc() << " ms: " << bvh.triangles().size() << " triangles, " << bvh.nodes().size() << " nodes.\n";
+        const auto camera = frame_scene(scene);
+        if (render)
+            render_cpu(bvh, scene, camera, size, render_options);
+        else
+            benchmark_cpu_bvh(bvh, scene, camera, size);
+    };
+
+    if (lct::host_backend_requested())
+    {
+        if (scene_path.empty())
+            return 0;
+        auto scene = lct::load_mesh_cache(scene_path, quantize);
+        LUISA_ASSERT(scene, "Cannot write the mesh cache of {}.", scene_path);
+        run_cpu(scene);
+        return 0;
+    }
+
+    Device device = lct::create_device(context);
+    if (precompile)
+    {
+        compile_render_shader(context, device, true);
+        return 0;
+    }
     Stream stream = device.create_stream();
 
-    
     AccelOption accel_option;
     accel_option.allow_compaction = false;
     accel_option.allow_update = false;
     accel_option.hint = AccelOption::UsageHint::FAST_TRACE;
     Accel accel = device.create_accel(accel_option);
-}
\ No newline at end of file
+
+    if (scene_path.empty())
+        return 0;
+    luisa::Clock clock;
+    clock.tic();
+    auto scene = lct::load_mesh_cache(scene_path, quantize);
+    LUISA_ASSERT(scene, "Cannot write the mesh cache of {}.", scene_path);
+    const auto &header = scene.header();
+    std::cout << "Loaded " << scene_path << " in " << clock.toc() << " ms: " << header.vertex_count << " vertices, "
+              << header.index_count / 3u << " triangles, " << header.range_count << " meshes.\n";
+
+    // One mesh per (shape, material) range, uploaded straight from the mapping. The renderer finds the vertices and
+    // triangles of instance r in bindless slots 2r and 2r + 1.
+    BindlessArray heap = device.create_bindless_array(std::max(2u * header.range_count, 1u));
+    std::vector<Buffer<float3>> vertex_buffers;
+    std::vector<Buffer<Triangle>> triangle_buffers;
+    std::vector<Mesh> meshes;
+    for (uint r = 0u; r < header.range_count; ++r)
+    {
+        const auto &range = scene.ranges()[r];
+        auto &vertices = vertex_buffers.emplace_back(device.create_buffer<float3>(range.vertex_count));
+        auto &triangles = triangle_buffers.emplace_back(device.create_buffer<Triangle>(range.index_count / 3u));
+        auto &mesh = meshes.emplace_back(device.create_mesh(vertices, triangles));
+        stream << vertices.copy_from(scene.positions() + 4u * range.first_vertex)
+               << triangles.copy_from(scene.indices() + range.first_index)
+               << mesh.build() << synchronize();
+        accel.emplace_back(mesh);
+        heap.emplace_on_update(2u * r, vertices);
+        heap.emplace_on_update(2u * r + 1u, triangles);
+    }
+    stream << accel.build() << heap.update() << synchronize();
+    std::cout << "Acceleration structure built in " << clock.toc() << " ms total.\n";
+
+    if (cpu)
+        run_cpu(scene);
+    else if (render)
+        render_device(context, device, stream, accel, heap, frame_scene(scene), size, render_options);
+}
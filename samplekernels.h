@@ -0,0 +1,31 @@
+#pragma once
+
+#include <luisa-compute.h>
+
+namespace lct
+{
+    // The kernels of sampletest, shared with lct-bench.
+
+    // Converts an image to grayscale in place.
+    inline auto make_grayscale_kernel()
+    {
+        return luisa::compute::Kernel2D{[](luisa::compute::ImageFloat image) noexcept
+                                        {
+                                            luisa::compute::Var coord = luisa::compute::dispatch_id().xy();
+                                            luisa::compute::Var pixel_color = image->read(coord);
+                                            luisa::compute::Var grayscale = luisa::compute::dot(pixel_color, luisa::compute::make_float4(0.2126f, 0.7152f, 0.0722f, 0.0f));
+                                            image->write(coord, luisa::compute::make_float4(luisa::compute::make_float3(grayscale), 1.0f));
+                                        }};
+    }
+
+    // Resamples bindless texture 0 to the dispatch extent of `to`.
+    inline auto make_sampling_kernel()
+    {
+        return luisa::compute::Kernel2D{[](luisa::compute::BindlessVar from, luisa::compute::ImageFloat to) noexcept
+                                        {
+                                            luisa::compute::Var coord = luisa::compute::dispatch_id().xy();
+                                            luisa::compute::Var normalized_coord = luisa::compute::make_float2(coord) / luisa::compute::make_float2(luisa::compute::dispatch_size().xy());
+                                            to.write(coord, from.tex2d(0u).sample(normalized_coord));
+                                        }};
+    }
+}
@@ -1,41 +1,77 @@
 #include <luisa-compute.h>
 #include <iostream>
-#include <lodepng.h>
+#include <imageio.h>
+#include <backend.h>
+#include <shadercache.h>
+#include <imageops.h>
+#include <trace.h>
+#include <frameloop.h>
 
-int main(int, char **argv)
+using StageTrace = lct::StageTraceScope<luisa::compute::Stream>;
+
+int main(int argc, char **argv)
 {
+    bool precompile = false;
+    std::string image_path = "/home/tianyu/testimage.png";
+    lct::FrameLoopOptions frame_loop;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string_view(argv[i]) == "--precompile")
+            precompile = true;
+        else if (std::string_view(argv[i]) == "--image" && i + 1 < argc)
+            image_path = argv[++i];
+        else if (!frame_loop.parse(argc, argv, i))
+        {
+            std::cerr << "Unknown option or missing value: " << argv[i] << "\n"
+                      << "Usage: st [--precompile] [--image <path>] " << lct::FrameLoopOptions::usage << "\n";
+            return 1;
+        }
+    }
     luisa::compute::Context context{argv[0]};
-    luisa::compute::Device device = context.create_device("cuda");
+    luisa::compute::Device device = lct::create_device(context);
     luisa::compute::Stream stream = device.create_stream(luisa::compute::StreamTag::GRAPHICS);
 
-    std::vector<unsigned char> image_png_buffer = {};
-    unsigned int error = lodepng::load_file(image_png_buffer, "/home/tianyu/testimage.png");
-    std::vector<unsigned char> image_buffer = {};
-    unsigned int width, height;
-    if (!error)
-        error = lodepng::decode(image_buffer, width, height, image_png_buffer);
-    if (error)
+    auto window_resolution = luisa::compute::make_uint2(400u, 400u);
+
+    // Grayscale and resample in one pass, instead of a full-resolution grayscale pass, a sync and a resample.
+    lct::ImageOpGraph graph;
+    graph.then(lct::ImageOp::luminance()).resample(lct::ImageOpGraph::Filter::bilinear);
+
+    lct::ShaderCache cache(context, device, "st", precompile);
+    lct::ImageOpShaders image_ops(device, cache);
+    image_ops.prepare(graph);
+    cache.report();
+    if (precompile)
+        return 0;
+
+    // An RGBA8 .pam is uploaded straight from the file mapping; other formats are decoded first.
+    lct::ImageFile image_file;
+    if (auto error = lct::read_image(image_path, image_file))
     {
-        std::cerr << lodepng_error_text(error) << std::endl;
+        std::cerr << image_path << ": " << error << std::endl;
         exit(1);
     }
-    std::cout << "Image loaded. Width: " << width << ", height: " << height << ".\n";
+    const unsigned int width = image_file.width(), height = image_file.height();
+    std::cout << "Image loaded. Width: " << width << ", height: " << height << (image_file.mapped() ? " (mapped)" : "") << ".\n";
 
     luisa::compute::Image<float> image = device.create_image<float>(luisa::compute::PixelStorage::BYTE4, width, height, 0u);
-    stream << image.copy_from(image_buffer.data()) << luisa::compute::synchronize();
 
-    luisa::compute::Kernel2D pixel_level_process = [&](luisa::compute::ImageFloat image) noexcept
-    {
-        luisa::compute::Var coord = luisa::compute::dispatch_id().xy();
-        luisa::compute::Var pixel_color = image->read(coord);
-        luisa::compute::Var grayscale = luisa::compute::dot(pixel_color, luisa::compute::make_float4(0.2126f, 0.7152f, 0.0722f, 0.0f));
-        image->write(coord, luisa::compute::make_float4(luisa::compute::make_float3(grayscale), 1.0f));
-    };
+    luisa::compute::BindlessArray bindless = device.create_bindless_array(1u);
+    bindless.emplace_on_update(0u, image, luisa::compute::Sampler(luisa::compute::Sampler::Filter::LINEAR_LINEAR, luisa::compute::Sampler::Address::REPEAT));
 
-    auto shader = device.compile(pixel_level_process);
-    stream << shader(image).dispatch(width, height) << luisa::compute::synchronize();
+    if (frame_loop.frames > 0u)
+    {
+        stream << image.copy_from(image_file.pixels()) << bindless.update() << luisa::compute::synchronize();
+        lct::HeadlessFrameLoop<luisa::compute::Stream> loop(stream, frame_loop.ring);
+        std::vector<luisa::compute::Image<float>> back_buffers;
+        for (uint32_t i = 0u; i < loop.ring(); ++i)
+            back_buffers.emplace_back(device.create_image<float>(luisa::compute::PixelStorage::BYTE4, window_resolution, 0u));
+        loop.run(frame_loop.frames, [&](luisa::compute::CommandList &cmds, uint32_t, uint32_t slot)
+                 { image_ops.record(cmds, graph, bindless, back_buffers[slot]); });
+        loop.report("st");
+        return 0;
+    }
 
-    auto window_resolution = luisa::compute::make_uint2(400u, 400u);
     luisa::compute::Window window("Display", window_resolution);
     luisa::compute::Swapchain swapchain = device.create_swapchain(stream, luisa::compute::SwapchainOption{
                                                                               .back_buffer_count = 2u,
@@ -46,23 +82,23 @@ int main(int, char **argv)
                                                                               .size = window_resolution});
 
     luisa::compute::Image<float> display = device.create_image<float>(luisa::compute::PixelStorage::BYTE4, window_resolution, 0u);
-    luisa::compute::BindlessArray bindless = device.create_bindless_array(1u);
-    bindless.emplace_on_update(0u, image, luisa::compute::Sampler(luisa::compute::Sampler::Filter::LINEAR_LINEAR, luisa::compute::Sampler::Address::REPEAT));
-    luisa::compute::Kernel2D image_sampling_kernel = [&](luisa::compute::BindlessVar from, luisa::compute::ImageFloat to) noexcept {
-        luisa::compute::Var coord = luisa::compute::dispatch_id().xy();
-        luisa::compute::Var normalized_coord = luisa::compute::make_float2(coord) / luisa::compute::make_float2(window_resolution);
-        to.write(coord, from.tex2d(0u).sample(normalized_coord));
-    };
 
-    stream << bindless.update() << device.compile(image_sampling_kernel)(bindless, display).dispatch(window_resolution) << luisa::compute::synchronize();
+    {
+        StageTrace stage(stream, "upload_and_sample");
+        luisa::compute::CommandList cmds;
+        cmds << image.copy_from(image_file.pixels()) << bindless.update();
+        image_ops.record(cmds, graph, bindless, display);
+        stream << cmds.commit() << luisa::compute::synchronize();
+    }
 
     while (!window.should_close())
     {
         window.poll_events();
 
+        StageTrace stage(stream, "present");
         stream << swapchain.present(display);
     }
     stream << luisa::compute::synchronize();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,303 +1,824 @@
 #include <iostream>
-#include <luisa-compute.h>
-#include <lodepng.h>
-#include <vector>
+#include <imageio.h>
+#include <seamcarving.h>
+#include <videoseamcarving.h>
+#include <workqueue.h>
+#include <atomic>
+#include <filesystem>
+#include <sstream>
+#include <thread>
 
-using namespace luisa;
-using namespace luisa::compute;
+// Seam order maps are cached next to the source image as "<image>.scorder": a small header identifying the
+// source pixels, followed by width * height uint32 carving steps.
+constexpr char seam_order_magic[8] = {'L', 'C', 'T', 'O', 'R', 'D', 'E', 'R'};
+constexpr uint seam_order_version = 1u;
 
-struct SeamCarving
+uint64_t hash_pixels(const unsigned char *image_buffer, uint width, uint height)
 {
-    Context &context;
-    Device device;
-    Stream stream;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0u; i < static_cast<size_t>(width) * height * 4u; ++i)
+        hash = (hash ^ image_buffer[i]) * 1099511628211ull;
+    return hash;
+}
 
-    Shader<2UL, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, BindlessArray> energy_shader;
-    Shader<1UL, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, uint> cost_shader_vertical;
-    Shader<1UL, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, uint> cost_shader_horizontal;
+bool load_seam_order(const std::string &path, const unsigned char *image_buffer, uint width, uint height, uint &min_width, std::vector<uint> &order)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    char magic[8];
+    uint header[4];
+    uint64_t hash;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&hash), sizeof(hash));
+    if (!file || !std::equal(magic, magic + 8, seam_order_magic) || header[0] != seam_order_version ||
+        header[1] != width || header[2] != height || header[3] > min_width || hash != hash_pixels(image_buffer, width, height))
+        return false;
+    order.resize(width * height);
+    file.read(reinterpret_cast<char *>(order.data()), order.size() * sizeof(uint));
+    min_width = header[3];
+    return static_cast<bool>(file);
+}
+
+void save_seam_order(const std::string &path, const unsigned char *image_buffer, uint width, uint height, uint min_width, const std::vector<uint> &order)
+{
+    std::ofstream file(path, std::ios::binary);
+    uint header[4] = {seam_order_version, width, height, min_width};
+    auto hash = hash_pixels(image_buffer, width, height);
+    file.write(seam_order_magic, sizeof(seam_order_magic));
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    file.write(reinterpret_cast<const char *>(order.data()), order.size() * sizeof(uint));
+}
+
+bool save_image(const std::string &path, const std::vector<unsigned char> &image_buffer, uint width, uint height, const lct::ImageWriteOptions &options)
+{
+    if (auto error = lct::write_image(path, image_buffer, width, height, options))
+    {
+        std::cerr << path << ": " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+void retarget_interactive(SeamCarving &sc, const std::string &image_path, const unsigned char *image_buffer, uint width, uint height, const lct::ImageWriteOptions &write_options)
+{
+    std::cout << "Enter minimum width:\n";
+    uint min_width = 1u;
+    std::cin >> min_width;
+    min_width = std::clamp(min_width, 1u, width);
+    auto order_path = image_path + ".scorder";
+    std::vector<uint> order = {};
+    std::unique_ptr<SeamCarving::Retargeter> retargeter;
+    Clock clock;
+    clock.tic();
+    if (load_seam_order(order_path, image_buffer, width, height, min_width, order))
+    {
+        retargeter = std::make_unique<SeamCarving::Retargeter>(sc, image_buffer, width, height, min_width, order);
+        std::cout << "Seam order loaded from " << order_path << " in " << clock.toc() << " ms.\n";
+    }
+    else
+    {
+        retargeter = std::make_unique<SeamCarving::Retargeter>(sc, image_buffer, width, height, min_width);
+        retargeter->download_order(order);
+        save_seam_order(order_path, image_buffer, width, height, min_width, order);
+        std::cout << "Seam order computed in " << clock.toc() << " ms and saved to " << order_path << ".\n";
+    }
 
-    SeamCarving(Context &context) : context(context)
+    std::vector<unsigned char> result_image = {};
+    while (true)
     {
-        device = context.create_device("cuda");
-        stream = device.create_stream(StreamTag::COMPUTE);
+        std::cout << "Enter target width [" << min_width << ", " << width << "] (0 to stop):\n";
+        uint target_width = 0u;
+        std::cin >> target_width;
+        if (target_width == 0u)
+            break;
+        target_width = std::clamp(target_width, min_width, width);
+        retargeter->retarget(target_width, result_image);
+        std::cout << "Enter output path:\n";
+        std::string output_path;
+        std::cin >> output_path;
+        save_image(output_path, result_image, target_width, height, write_options);
+    }
+}
 
-        Callable luminance = [](Float4 rgba) noexcept
+void carve_out_of_core(SeamCarving &sc, std::vector<unsigned char> &image_buffer, uint width, uint height, uint strip_rows, const std::string &spill_path, const lct::ImageWriteOptions &write_options)
+{
+    SeamCarving::StreamingCarver carver(sc, image_buffer, width, height, strip_rows, spill_path);
+    std::cout << "Streaming " << carver.strip_count() << " strips of " << carver.strip_rows << " rows.\n";
+    std::cout << "Enter vertical offset:\n";
+    int offset = 0;
+    std::cin >> offset;
+    for (int i = 0; i < offset && carver.width > 1u; ++i)
+        carver.delete_seam();
+
+    std::cout << "Enter output path:\n";
+    std::string output_path;
+    std::cin >> output_path;
+    save_image(output_path, image_buffer, carver.width, carver.height, write_options);
+}
+
+// Removes `seams` seams, `batch` at a time when batch > 1, but never the last row or column. Returns the number
+// actually removed.
+template <SeamOrientation _O, typename Carver>
+uint carve(Carver &session, uint seams, uint batch, float max_cost_ratio)
+{
+    const uint extent = _O == SeamOrientation::VERTICAL ? session.width : session.height;
+    seams = std::min(seams, extent - 1u);
+    uint removed = 0u;
+    while (removed < seams)
+    {
+        if (batch <= 1u)
         {
-            return 0.2126f * rgba.x + 0.7152f * rgba.y + 0.0722f * rgba.z;
-        };
+            session.template delete_seam<_O>();
+            ++removed;
+            continue;
+        }
+        auto count = session.template delete_seams<_O>(std::min(batch, seams - removed), max_cost_ratio);
+        if (count == 0u)
+            break;
+        removed += count;
+    }
+    return removed;
+}
 
-        Kernel2D energy_kernel = [&luminance](ImageFloat out, BindlessVar in_bindless) noexcept
+void benchmark_batches(SeamCarving &sc, const unsigned char *image_buffer, uint width, uint height, uint seams, float max_cost_ratio)
+{
+    for (uint batch = 1u; batch <= 64u; batch *= 2u)
+    {
+        SeamCarving::Session session(sc, image_buffer, width, height);
+        Clock clock;
+        clock.tic();
+        auto removed = carve<SeamCarving::Orientation::VERTICAL>(session, seams, batch, max_cost_ratio);
+        auto ms = clock.toc();
+        std::cout << "k = " << batch << ": " << removed << " seams in " << ms << " ms, "
+                  << removed * 1000.0 / ms << " seams/s.\n";
+    }
+}
+
+// Carves the same seams with a device session and with HostSeamCarving, alternating orientations, and compares the
+// images after every step.
+void verify_against_host(SeamCarving &sc, const unsigned char *image_buffer, uint width, uint height, uint seams, uint batch, float max_cost_ratio)
+{
+    SeamCarving::Session session(sc, image_buffer, width, height);
+    HostSeamCarving host(image_buffer, width, height);
+    std::vector<unsigned char> device_result = {};
+    std::vector<unsigned char> host_result = {};
+    for (uint step = 0u; step < seams && session.width > 1u && session.height > 1u; ++step)
+    {
+        if (step % 2u == 0u)
         {
-            Var coord = dispatch_id().xy();
-            Var resolution = make_float2(dispatch_size().xy());
-            auto in = in_bindless.tex2d(0u);
-            auto dx = luminance((in.sample(make_float2(coord.x + 1.f, coord.y - 1.f) / resolution) + 2.0f * in.sample(make_float2(coord.x + 1.f, coord.y * 1.f) / resolution) + in.sample(make_float2(coord.x + 1.f, coord.y + 1.f) / resolution)) -
-                                (in.sample(make_float2(coord.x - 1.f, coord.y - 1.f) / resolution) + 2.0f * in.sample(make_float2(coord.x - 1.f, coord.y * 1.f) / resolution) + in.sample(make_float2(coord.x - 1.f, coord.y + 1.f) / resolution)));
-            auto dy = luminance((in.sample(make_float2(coord.x - 1.f, coord.y + 1.f) / resolution) + 2.0f * in.sample(make_float2(coord.x * 1.f, coord.y + 1.f) / resolution) + in.sample(make_float2(coord.x + 1.f, coord.y + 1.f) / resolution)) -
-                                (in.sample(make_float2(coord.x - 1.f, coord.y - 1.f) / resolution) + 2.0f * in.sample(make_float2(coord.x * 1.f, coord.y - 1.f) / resolution) + in.sample(make_float2(coord.x + 1.f, coord.y - 1.f) / resolution)));
-            out.write(make_uint2(coord.x, coord.y), make_float4(make_float3(luisa::compute::sqrt((dx * dx + dy * dy))), 1.0f));
-        };
-
-        Kernel1D cost_kernel_vertical = [](ImageFloat cost_map, ImageFloat energy_map, UInt y) noexcept
+            carve<SeamOrientation::VERTICAL>(session, std::max(batch, 1u), batch, max_cost_ratio);
+            carve<SeamOrientation::VERTICAL>(host, std::max(batch, 1u), batch, max_cost_ratio);
+        }
+        else
         {
-            Var x = dispatch_id().x;
-            Float lt = std::numeric_limits<float>::infinity();
-            Float t = cost_map.read(make_uint2(x, y - 1)).x;
-            Float rt = std::numeric_limits<float>::infinity();
-            $if(x > 0)
-            {
-                lt = cost_map.read(make_uint2(x - 1, y - 1)).x;
-            };
-            $if(x + 1 < dispatch_size_x())
-            {
-                rt = cost_map.read(make_uint2(x + 1, y - 1)).x;
-            };
-            Var cost = energy_map.read(make_uint2(x, y)).x + min(min(lt, t), rt);
-            cost_map.write(make_uint2(x, y), make_float4(make_float3(cost), 1.0f));
-        };
-
-        Kernel1D cost_kernel_horizontal = [](ImageFloat cost_map, ImageFloat energy_map, UInt x) noexcept
+            carve<SeamOrientation::HORIZONTAL>(session, std::max(batch, 1u), batch, max_cost_ratio);
+            carve<SeamOrientation::HORIZONTAL>(host, std::max(batch, 1u), batch, max_cost_ratio);
+        }
+        session.download(device_result);
+        host.download(host_result);
+        if (session.width != host.width || session.height != host.height || device_result != host_result)
         {
-            Var y = dispatch_id().x;
-            Float lt = std::numeric_limits<float>::infinity();
-            Float t = cost_map.read(make_uint2(x - 1, y)).x;
-            Float rt = std::numeric_limits<float>::infinity();
-            $if(y > 0)
-            {
-                lt = cost_map.read(make_uint2(x - 1, y - 1)).x;
-            };
-            $if(y + 1 < dispatch_size_x())
-            {
-                rt = cost_map.read(make_uint2(x - 1, y + 1)).x;
-            };
-            Var cost = energy_map.read(make_uint2(x, y)).x + min(min(lt, t), rt);
-            cost_map.write(make_uint2(x, y), make_float4(make_float3(cost), 1.0f));
-        };
-
-        energy_shader = device.compile(energy_kernel);
-        cost_shader_vertical = device.compile(cost_kernel_vertical);
-        cost_shader_horizontal = device.compile(cost_kernel_horizontal);
+            auto mismatch = std::mismatch(device_result.begin(), device_result.end(), host_result.begin(), host_result.end());
+            std::cout << "Mismatch after step " << step << ": device " << session.width << "x" << session.height
+                      << ", host " << host.width << "x" << host.height << ", first differing pixel "
+                      << (mismatch.first - device_result.begin()) / 4 << ".\n";
+            return;
+        }
     }
+    std::cout << "Device and host agree: " << session.width << "x" << session.height << ".\n";
+}
+
+void save_image_interactive(const std::vector<unsigned char> &image_buffer, uint width, uint height, const lct::ImageWriteOptions &write_options)
+{
+    std::cout << "Enter output path:\n";
+    std::string output_path;
+    std::cin >> output_path;
+    save_image(output_path, image_buffer, width, height, write_options);
+}
 
-    enum struct Orientation
+// Writes the session's energy and vertical cost maps as <prefix>_energy.pfm and <prefix>_cost.pfm.
+void dump_maps_interactive(SeamCarving::Session &session)
+{
+    std::cout << "Enter output path prefix:\n";
+    std::string prefix;
+    std::cin >> prefix;
+    std::vector<float> energy, cost;
+    session.download_maps(energy, cost);
+    for (const auto &[name, map] : {std::pair{"energy", &energy}, std::pair{"cost", &cost}})
     {
-        VERTICAL,
-        HORIZONTAL
-    };
+        if (map->empty())
+        {
+            std::cout << "Skipping the " << name << " map, it is stored in half precision.\n";
+            continue;
+        }
+        auto path = prefix + "_" + name + ".pfm";
+        if (auto error = lct::write_float_image(path, map->data(), session.width, session.height))
+            std::cerr << path << ": " << error << "\n";
+        else
+            std::cout << "Wrote " << path << ".\n";
+    }
+}
 
-    template <Orientation _O = Orientation::VERTICAL>
-    auto delete_seam(std::vector<unsigned char> image_buffer, uint &width, uint &height) -> std::vector<unsigned char>
+void carve_on_host(const unsigned char *image_buffer, uint width, uint height, const lct::ImageWriteOptions &write_options)
+{
+    HostSeamCarving carver(image_buffer, width, height);
+    std::string op;
+    int offset = 0;
+    uint batch = 1u;
+    float max_cost_ratio = std::numeric_limits<float>::infinity();
+    while (true)
     {
-        // Begin device commands.
-        Image<float> image = device.create_image<float>(PixelStorage::BYTE4, width, height, 0u);
-        Image<float> image_energy = device.create_image<float>(PixelStorage::FLOAT4, width, height, 0u);
-        Image<float> image_cost = device.create_image<float>(PixelStorage::FLOAT4, width, height, 0u);
-        BindlessArray bindless = device.create_bindless_array(1u);
-        bindless.emplace_on_update(0u, image, Sampler(Sampler::Filter::LINEAR_LINEAR, Sampler::Address::MIRROR));
-        std::vector<float4> download_image_cost(width * height);
-        stream << image.copy_from(image_buffer.data()) << synchronize();
-        stream << bindless.update() << energy_shader(image_energy, bindless).dispatch(width, height) << synchronize();
-        stream << image_cost.copy_from(image_energy) << synchronize();
-        if constexpr (_O == Orientation::VERTICAL)
+        std::cout << "Enter operation [h/v/k/e]:\n";
+        std::cin >> op;
+        if (op.starts_with('h') || op.starts_with('v'))
+        {
+            std::cout << "Enter offset:\n";
+            std::cin >> offset;
+            Clock clock;
+            clock.tic();
+            auto removed = op.starts_with('h') ? carve<SeamOrientation::HORIZONTAL>(carver, offset, batch, max_cost_ratio)
+                                               : carve<SeamOrientation::VERTICAL>(carver, offset, batch, max_cost_ratio);
+            std::cout << removed << " seams in " << clock.toc() << " ms.\n";
+        }
+        else if (op.starts_with('k'))
         {
-            for (uint y = 1; y < height; ++y)
-                stream << cost_shader_vertical(image_cost, image_energy, y).dispatch(width) << synchronize();
+            std::cout << "Enter seams per pass and max cost ratio (inf for none):\n";
+            std::string ratio;
+            std::cin >> batch >> ratio;
+            max_cost_ratio = std::stof(ratio);
         }
         else
         {
-            for (uint x = 1; x < width; ++x)
-                stream << cost_shader_horizontal(image_cost, image_energy, x).dispatch(height) << synchronize();
+            break;
         }
-        stream << image_cost.copy_to(download_image_cost.data()) << synchronize();
-        // End device commands.
+    }
+    std::vector<unsigned char> result_image = {};
+    carver.download(result_image);
+    save_image_interactive(result_image, carver.width, carver.height, write_options);
+}
+
+// Carves vertical seams down to target_width, then horizontal seams down to target_height. A zero target or one
+// above the current extent leaves that dimension alone.
+template <typename Carver>
+void carve_to(Carver &carver, uint target_width, uint target_height, uint batch)
+{
+    constexpr float max_cost_ratio = std::numeric_limits<float>::infinity();
+    if (target_width > 0u && target_width < carver.width)
+        carve<SeamOrientation::VERTICAL>(carver, carver.width - target_width, batch, max_cost_ratio);
+    if (target_height > 0u && target_height < carver.height)
+        carve<SeamOrientation::HORIZONTAL>(carver, carver.height - target_height, batch, max_cost_ratio);
+}
+
+struct BatchOptions
+{
+    std::string input;
+    std::string output_directory = ".";
+    std::vector<uint2> targets;
+    uint threads = std::max(std::thread::hardware_concurrency() / 2u, 1u);
+    // Carving workers: one device stream each, or host carvers with LCT_BACKEND=host.
+    uint streams = 2u;
+    uint queue_depth = 4u;
+    uint seams_per_pass = 1u;
+    // Extension of the carved images, any format lct::write_image knows.
+    std::string output_extension = ".png";
+    lct::ImageWriteOptions write;
+};
+
+struct BatchJob
+{
+    std::filesystem::path input;
+    uint2 target;
+};
+
+bool parse_size(const std::string &text, uint2 &size)
+{
+    auto x = text.find('x');
+    if (x == std::string::npos)
+        return false;
+    try
+    {
+        size = make_uint2(static_cast<uint>(std::stoul(text.substr(0u, x))), static_cast<uint>(std::stoul(text.substr(x + 1u))));
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return true;
+}
 
-        // Begin find seam.
-        uint trace_start = 0u;
-        float min_value = std::numeric_limits<float>::infinity();
-        if constexpr (_O == Orientation::VERTICAL)
+// A directory contributes every image in it that lct::read_image can decode. A manifest lists one image per line, optionally followed by its own
+// WxH target; relative paths are taken from the manifest's directory and '#' starts a comment line.
+std::vector<BatchJob> collect_batch_jobs(const BatchOptions &options)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::pair<fs::path, std::vector<uint2>>> images;
+    if (fs::is_directory(options.input))
+    {
+        for (const auto &entry : fs::directory_iterator(options.input))
+            if (entry.is_regular_file() && lct::is_image_path(entry.path()))
+                images.emplace_back(entry.path(), options.targets);
+        std::sort(images.begin(), images.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+    }
+    else
+    {
+        std::ifstream manifest(options.input);
+        LUISA_ASSERT(manifest, "Cannot open batch manifest {}.", options.input);
+        auto base = fs::path(options.input).parent_path();
+        for (std::string line; std::getline(manifest, line);)
         {
-            for (uint i = 0; i < width; ++i)
-            {
-                if (download_image_cost[(height - 1) * width + i].x < min_value)
-                {
-                    min_value = download_image_cost[(height - 1) * width + i].x;
-                    trace_start = i;
-                }
-            }
+            std::istringstream fields(line);
+            std::string path, size_text;
+            if (!(fields >> path) || path.starts_with('#'))
+                continue;
+            std::vector<uint2> targets = options.targets;
+            uint2 size;
+            if (fields >> size_text && parse_size(size_text, size))
+                targets = {size};
+            images.emplace_back(fs::path(path).is_absolute() ? fs::path(path) : base / path, std::move(targets));
         }
-        else
+    }
+    std::vector<BatchJob> jobs;
+    for (auto &[path, targets] : images)
+        for (auto target : targets)
+            jobs.push_back({path, target});
+    return jobs;
+}
+
+// Per-stage busy time, so utilization can be reported against the wall time of the whole batch.
+struct BatchStage
+{
+    const char *name;
+    uint threads;
+    std::atomic<double> busy_ms = 0.0;
+    std::atomic<uint> items = 0u;
+
+    void report(double wall_ms) const
+    {
+        std::cout << "  " << name << ": " << items.load() << " items on " << threads << " threads, "
+                  << busy_ms.load() / 1000.0 << " s busy, " << 100.0 * busy_ms.load() / (wall_ms * threads) << "% utilization.\n";
+    }
+};
+
+// Headless batch carving as a three-stage pipeline: image decode on a thread pool, carving on one worker per device
+// stream (or HostSeamCarving with LCT_BACKEND=host), and image encode on a second pool. Bounded queues between the
+// stages keep decoding from running arbitrarily far ahead of the device and the device from outrunning encoding.
+void run_batch(Context &context, const BatchOptions &options)
+{
+    // The decoded file is uploaded as is and released once carved; pixels holds the carved result.
+    struct BatchImage
+    {
+        BatchJob job;
+        lct::ImageFile file;
+        std::vector<unsigned char> pixels;
+        uint width = 0u;
+        uint height = 0u;
+    };
+
+    auto jobs = collect_batch_jobs(options);
+    if (jobs.empty())
+    {
+        std::cerr << "No images to carve (give targets with --target WxH or per manifest line).\n";
+        return;
+    }
+    std::filesystem::create_directories(options.output_directory);
+    const bool host = lct::host_backend_requested();
+    std::unique_ptr<SeamCarving> sc;
+    if (!host)
+        sc = std::make_unique<SeamCarving>(context);
+
+    const uint carvers = std::max(options.streams, 1u);
+    BatchStage decode{"decode", options.threads};
+    BatchStage carve_stage{host ? "carve (host)" : "carve", carvers};
+    BatchStage encode{"encode", options.threads};
+    lct::BoundedQueue<BatchImage> decoded(options.queue_depth);
+    lct::BoundedQueue<BatchImage> carved(options.queue_depth);
+    std::atomic<size_t> next_job = 0u;
+    std::atomic<uint> failed = 0u;
+
+    auto decode_worker = [&]
+    {
+        for (size_t index; (index = next_job++) < jobs.size();)
         {
-            for (uint i = 0; i < height; ++i)
+            BatchImage image{jobs[index]};
+            const char *error;
             {
-                if (download_image_cost[(i + 1) * width - 1].x < min_value)
-                {
-                    min_value = download_image_cost[(i + 1) * width - 1].x;
-                    trace_start = i;
-                }
+                // Scopes end before the queue push, so waiting on a full queue is not traced as stage work.
+                lct::TraceScope scope("decode");
+                Clock clock;
+                clock.tic();
+                error = lct::read_image(image.job.input.string(), image.file);
+                image.width = image.file.width();
+                image.height = image.file.height();
+                decode.busy_ms += clock.toc();
             }
+            if (error)
+            {
+                std::cerr << image.job.input.string() << ": " << error << "\n";
+                ++failed;
+                continue;
+            }
+            ++decode.items;
+            decoded.push(std::move(image));
         }
-        // std::cout << "Trace start:" << trace_start << std::endl;
-        std::vector<uint> seam = {};
-        seam.push_back(trace_start);
-        if constexpr (_O == Orientation::VERTICAL)
+    };
+    // One worker per device stream, so uploads, kernels and downloads of different images overlap.
+    auto carve_worker = [&]
+    {
+        Stream stream;
+        if (!host)
+            stream = sc->device.create_stream(StreamTag::COMPUTE);
+        while (auto image = decoded.pop())
         {
-            for (uint i = height - 1; i > 0; --i)
             {
-                const auto &current_x = seam.back();
-                float lt = std::numeric_limits<float>::infinity();
-                float rt = std::numeric_limits<float>::infinity();
-                float t = download_image_cost[(i - 1) * width + current_x].x;
-                if (current_x > 0)
-                {
-                    lt = download_image_cost[(i - 1) * width + current_x - 1].x;
-                }
-                if (current_x + 1 < width)
-                {
-                    rt = download_image_cost[(i - 1) * width + current_x + 1].x;
-                }
-                uint current_x_candidate = current_x;
-                if (lt < t)
+                lct::TraceScope scope("carve");
+                Clock clock;
+                clock.tic();
+                if (host)
                 {
-                    t = lt;
-                    current_x_candidate = current_x - 1;
+                    HostSeamCarving carver(image->file.pixels(), image->width, image->height);
+                    carve_to(carver, image->job.target.x, image->job.target.y, options.seams_per_pass);
+                    carver.download(image->pixels);
+                    image->width = carver.width;
+                    image->height = carver.height;
                 }
-                if (rt < t)
+                else
                 {
-                    current_x_candidate = current_x + 1;
+                    SeamCarving::Session session(*sc, stream, image->file.pixels(), image->width, image->height);
+                    carve_to(session, image->job.target.x, image->job.target.y, options.seams_per_pass);
+                    session.download(image->pixels);
+                    image->width = session.width;
+                    image->height = session.height;
                 }
-                seam.push_back(current_x_candidate);
+                image->file = lct::ImageFile();
+                carve_stage.busy_ms += clock.toc();
             }
+            ++carve_stage.items;
+            carved.push(std::move(*image));
         }
-        else
+    };
+    auto encode_worker = [&]
+    {
+        while (auto image = carved.pop())
         {
-            for (uint i = width - 1; i > 0; --i)
+            lct::TraceScope scope("encode");
+            Clock clock;
+            clock.tic();
+            auto name = luisa::format("{}_{}x{}{}", image->job.input.stem().string(), image->width, image->height, options.output_extension);
+            auto output = (std::filesystem::path(options.output_directory) / name.c_str()).string();
+            auto error = lct::write_image(output, image->pixels, image->width, image->height, options.write);
+            encode.busy_ms += clock.toc();
+            if (error)
             {
-                const auto &current_y = seam.back();
-                float lt = std::numeric_limits<float>::infinity();
-                float rt = std::numeric_limits<float>::infinity();
-                // (current_y - 1) * width + i
-                float t = download_image_cost[current_y * width + i - 1].x;
-                if (current_y > 0)
-                {
-                    lt = download_image_cost[(current_y - 1) * width + i - 1].x;
-                }
-                if (current_y + 1 < height)
-                {
-                    rt = download_image_cost[(current_y + 1) * width + i - 1].x;
-                }
-                uint current_y_candidate = current_y;
-                if (lt < t)
-                {
-                    t = lt;
-                    current_y_candidate = current_y - 1;
-                }
-                if (rt < t)
-                {
-                    current_y_candidate = current_y + 1;
-                }
-                seam.push_back(current_y_candidate);
+                std::cerr << output << ": " << error << "\n";
+                ++failed;
+                continue;
             }
+            ++encode.items;
         }
-        // End find seam.
+    };
 
-        // Begin new image creation.
-        std::vector<unsigned char> result_image;
-        if constexpr (_O == Orientation::VERTICAL)
+    Clock wall;
+    wall.tic();
+    std::vector<std::thread> decoders, carve_workers, encoders;
+    for (uint t = 0u; t < options.threads; ++t)
+    {
+        decoders.emplace_back(decode_worker);
+        encoders.emplace_back(encode_worker);
+    }
+    for (uint t = 0u; t < carvers; ++t)
+        carve_workers.emplace_back(carve_worker);
+    // Each stage ends once its producers are done and its queue is drained.
+    for (auto &thread : decoders)
+        thread.join();
+    decoded.close();
+    for (auto &thread : carve_workers)
+        thread.join();
+    carved.close();
+    for (auto &thread : encoders)
+        thread.join();
+    auto wall_ms = wall.toc();
+
+    std::cout << encode.items.load() << " of " << jobs.size() << " images carved in " << wall_ms / 1000.0 << " s, "
+              << encode.items.load() * 1000.0 / wall_ms << " images/s, " << failed.load() << " failed.\n";
+    decode.report(wall_ms);
+    carve_stage.report(wall_ms);
+    encode.report(wall_ms);
+}
+
+struct VideoOptions
+{
+    std::string input;
+    std::string output_directory = ".";
+    uint width = 0u;
+    uint queue_depth = 4u;
+    VideoSeamCarving::Options carving;
+    std::string output_extension = ".png";
+    lct::ImageWriteOptions write;
+};
+
+// Carves a directory of image frames, in name order, to one width with VideoSeamCarving. Frames depend on their
+// predecessor, so carving is a single in-order stage; decoding and encoding run on threads of their own with
+// bounded queues in between, so frame N + 1 decodes while frame N is carved and frame N - 1 is encoded.
+void run_video(const VideoOptions &options)
+{
+    namespace fs = std::filesystem;
+    // As in run_batch: the decoded file is carved from directly, and pixels holds the carved frame.
+    struct Frame
+    {
+        fs::path path;
+        lct::ImageFile file;
+        std::vector<unsigned char> pixels;
+        uint width = 0u;
+        uint height = 0u;
+    };
+
+    std::vector<fs::path> paths;
+    for (const auto &entry : fs::directory_iterator(options.input))
+        if (entry.is_regular_file() && lct::is_image_path(entry.path()))
+            paths.push_back(entry.path());
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty() || options.width == 0u)
+    {
+        std::cerr << "No frames to carve (give a directory of image frames and --width W).\n";
+        return;
+    }
+    fs::create_directories(options.output_directory);
+
+    BatchStage decode{"decode", 1u};
+    BatchStage carve_stage{"carve (host)", 1u};
+    BatchStage encode{"encode", 1u};
+    lct::BoundedQueue<Frame> decoded(options.queue_depth);
+    lct::BoundedQueue<Frame> carved(options.queue_depth);
+    std::atomic<uint> failed = 0u;
+
+    std::thread decoder([&]
+                        {
+        for (const auto &path : paths)
         {
-            uint new_width = width - 1;
-            result_image.resize(new_width * height * 4u);
-#pragma omp parallel for
-            for (uint i = 0; i < height; ++i)
+            Frame frame{path};
+            const char *error;
             {
-                uint jj = 0;
-                for (uint j = 0; j < width; ++j)
-                {
-                    if (seam[height - 1 - i] != j)
-                    {
-                        result_image[(i * new_width + jj) * 4u + 0u] = image_buffer[(i * width + j) * 4u + 0u];
-                        result_image[(i * new_width + jj) * 4u + 1u] = image_buffer[(i * width + j) * 4u + 1u];
-                        result_image[(i * new_width + jj) * 4u + 2u] = image_buffer[(i * width + j) * 4u + 2u];
-                        result_image[(i * new_width + jj) * 4u + 3u] = image_buffer[(i * width + j) * 4u + 3u];
-                        ++jj;
-                    }
-                }
+                lct::TraceScope scope("decode");
+                Clock clock;
+                clock.tic();
+                error = lct::read_image(path.string(), frame.file);
+                frame.width = frame.file.width();
+                frame.height = frame.file.height();
+                decode.busy_ms += clock.toc();
+            }
+            if (error)
+            {
+                std::cerr << path.string() << ": " << error << "\n";
+                ++failed;
+                continue;
             }
-            --width;
+            ++decode.items;
+            if (!decoded.push(std::move(frame)))
+                break;
         }
-        else
+        decoded.close(); });
+    std::thread encoder([&]
+                        {
+        while (auto frame = carved.pop())
         {
-            uint new_height = height - 1;
-            result_image.resize(width * new_height * 4u);
-#pragma omp parallel for
-            for (uint j = 0; j < width; ++j)
+            lct::TraceScope scope("encode");
+            Clock clock;
+            clock.tic();
+            auto output = (fs::path(options.output_directory) / frame->path.stem()).string() + options.output_extension;
+            auto error = lct::write_image(output, frame->pixels, frame->width, frame->height, options.write);
+            encode.busy_ms += clock.toc();
+            if (error)
             {
-                uint ii = 0;
-                for (uint i = 0; i < height; ++i)
-                {
-                    if (seam[width - 1 - j] != i)
-                    {
-                        result_image[(ii * width + j) * 4u + 0u] = image_buffer[(i * width + j) * 4u + 0u];
-                        result_image[(ii * width + j) * 4u + 1u] = image_buffer[(i * width + j) * 4u + 1u];
-                        result_image[(ii * width + j) * 4u + 2u] = image_buffer[(i * width + j) * 4u + 2u];
-                        result_image[(ii * width + j) * 4u + 3u] = image_buffer[(i * width + j) * 4u + 3u];
-                        ++ii;
-                    }
-                }
+                std::cerr << output << ": " << error << "\n";
+                ++failed;
+                continue;
             }
-            --height;
+            ++encode.items;
+        } });
+
+    Clock wall;
+    wall.tic();
+    std::unique_ptr<VideoSeamCarving> carver;
+    uint keyframes = 0u;
+    uint64_t reused = 0u;
+    uint64_t searched = 0u;
+    double energy = 0.0;
+    std::vector<unsigned char> result;
+    while (auto frame = decoded.pop())
+    {
+        if (!carver)
+            carver = std::make_unique<VideoSeamCarving>(frame->width, frame->height, options.width, options.carving);
+        if (frame->width != carver->width || frame->height != carver->height)
+        {
+            std::cerr << frame->path.string() << ": " << frame->width << "x" << frame->height << " does not match the first frame ("
+                      << carver->width << "x" << carver->height << ").\n";
+            ++failed;
+            continue;
         }
-        // End new image creation.
+        VideoSeamCarving::FrameStats stats;
+        {
+            lct::TraceScope scope("carve");
+            Clock clock;
+            clock.tic();
+            stats = carver->carve(frame->file.pixels(), result);
+            carve_stage.busy_ms += clock.toc();
+        }
+        ++carve_stage.items;
+        keyframes += stats.keyframe;
+        reused += stats.reused;
+        searched += stats.searched;
+        energy += stats.energy;
+        frame->file = lct::ImageFile();
+        frame->pixels.swap(result);
+        frame->width = carver->target_width;
+        carved.push(std::move(*frame));
+    }
+    carved.close();
+    decoder.join();
+    encoder.join();
+    auto wall_ms = wall.toc();
 
-        return result_image;
-    };
-};
+    const uint frames = carve_stage.items.load();
+    std::cout << encode.items.load() << " of " << paths.size() << " frames carved in " << wall_ms / 1000.0 << " s, "
+              << encode.items.load() * 1000.0 / wall_ms << " frames/s, " << failed.load() << " failed.\n";
+    if (frames > 0u)
+        std::cout << "  " << keyframes << " keyframes, " << reused << " seams reused and " << searched << " searched in a window of "
+                  << options.carving.window << ", " << 100.0 * energy / frames << "% of the energy recomputed per frame.\n";
+    decode.report(wall_ms);
+    carve_stage.report(wall_ms);
+    encode.report(wall_ms);
+}
 
-int main(int, char **argv)
+int main(int argc, char **argv)
 {
+    // --strip-rows <n> [--spill <path>] selects out-of-core carving for images larger than device memory.
+    // --half-energy stores the session energy map in half precision.
+    // --precompile builds the ahead-of-time shader bundle and exits.
+    // --batch <manifest|dir> --target WxH [--target WxH ...] [--out dir] [--threads n] [--streams n] [--queue n]
+    // [--seams-per-pass k] carves a whole set of images without prompting.
+    // --video <dir> --width W [--out dir] [--seam-window n] [--change-threshold t] [--scene-cut f] carves a sequence
+    // of frames with temporally coherent seams.
+    // Images are read as PNG, PPM/PGM, PAM, QOI or PFM by extension. --format <png|qoi|pam|ppm> picks the batch and
+    // video output format; --fast-png writes PNGs with parallel row filtering and a low-effort deflate.
+    uint strip_rows = 0u;
+    std::string spill_path;
+    bool half_energy = false;
+    bool precompile = false;
+    BatchOptions batch_options;
+    VideoOptions video_options;
+    lct::ImageWriteOptions write_options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        uint2 target;
+        if (arg == "--strip-rows" && i + 1 < argc)
+            strip_rows = std::stoul(argv[++i]);
+        else if (arg == "--spill" && i + 1 < argc)
+            spill_path = argv[++i];
+        else if (arg == "--half-energy")
+            half_energy = true;
+        else if (arg == "--precompile")
+            precompile = true;
+        else if (arg == "--batch" && i + 1 < argc)
+            batch_options.input = argv[++i];
+        else if (arg == "--target" && i + 1 < argc && parse_size(argv[i + 1], target))
+        {
+            batch_options.targets.push_back(target);
+            ++i;
+        }
+        else if (arg == "--out" && i + 1 < argc)
+            batch_options.output_directory = video_options.output_directory = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            batch_options.threads = std::max<uint>(std::stoul(argv[++i]), 1u);
+        else if (arg == "--streams" && i + 1 < argc)
+            batch_options.streams = std::stoul(argv[++i]);
+        else if (arg == "--queue" && i + 1 < argc)
+            batch_options.queue_depth = std::stoul(argv[++i]);
+        else if (arg == "--seams-per-pass" && i + 1 < argc)
+            batch_options.seams_per_pass = std::stoul(argv[++i]);
+        else if (arg == "--video" && i + 1 < argc)
+            video_options.input = argv[++i];
+        else if (arg == "--width" && i + 1 < argc)
+            video_options.width = std::stoul(argv[++i]);
+        else if (arg == "--seam-window" && i + 1 < argc)
+            video_options.carving.window = std::stoul(argv[++i]);
+        else if (arg == "--change-threshold" && i + 1 < argc)
+            video_options.carving.threshold = std::stof(argv[++i]);
+        else if (arg == "--scene-cut" && i + 1 < argc)
+            video_options.carving.scene_cut = std::stof(argv[++i]);
+        else if (arg == "--format" && i + 1 < argc)
+            batch_options.output_extension = video_options.output_extension = std::string(".") + argv[++i];
+        else if (arg == "--fast-png")
+            write_options.fast_png = true;
+    }
+    batch_options.write = video_options.write = write_options;
+
     Context context(argv[0]);
-    SeamCarving sc(context);
-    std::cout << "Context initialized.\n";
+    if (precompile)
+    {
+        SeamCarving sc(context, true);
+        return 0;
+    }
+    if (!video_options.input.empty())
+    {
+        run_video(video_options);
+        return 0;
+    }
+    if (!batch_options.input.empty())
+    {
+        run_batch(context, batch_options);
+        return 0;
+    }
     std::cout << "Enter image path:\n";
     std::string image_path;
     std::cin >> image_path;
 
-    std::vector<unsigned char> image_png_buffer = {};
-    unsigned int error = lodepng::load_file(image_png_buffer, image_path);
-    std::vector<unsigned char> image_buffer = {};
-    unsigned int width, height;
-    if (!error)
-        error = lodepng::decode(image_buffer, width, height, image_png_buffer);
-    if (error)
+    // Uploads read straight from the file: an RGBA8 PAM is never copied out of its mapping.
+    lct::ImageFile image;
+    if (auto error = lct::read_image(image_path, image))
     {
-        std::cerr << "Image load failed: " << lodepng_error_text(error) << std::endl;
+        std::cerr << "Image load failed: " << error << std::endl;
         exit(1);
     }
+    const uint width = image.width();
+    const uint height = image.height();
+    const unsigned char *image_buffer = image.pixels();
     std::cout << "Image loaded. Width: " << width << ", height: " << height << ".\n";
 
+    // LCT_BACKEND=host carves with the native host implementation and never creates a device.
+    if (lct::host_backend_requested())
+    {
+        carve_on_host(image_buffer, width, height, write_options);
+        return 0;
+    }
+
+    SeamCarving sc(context);
+    std::cout << "Context initialized.\n";
+
+    if (strip_rows > 0u)
+    {
+        // Streaming carves the host image in place, so it needs pixels of its own.
+        auto pixels = image.take();
+        carve_out_of_core(sc, pixels, width, height, strip_rows, spill_path, write_options);
+        return 0;
+    }
+
     std::string op;
-    auto result_image = image_buffer;
+    SeamCarving::Session session(sc, image_buffer, width, height, half_energy);
     int offset = 0;
+    uint batch = 1u;
+    float max_cost_ratio = std::numeric_limits<float>::infinity();
     while (true)
     {
-        std::cout << "Enter operation [h/v/e]:\n";
+        std::cout << "Enter operation [h/v/k/b/r/t/c/d/e]:\n";
         std::cin >> op;
         if (op.starts_with('h'))
         {
             std::cout << "Enter offset:\n";
             std::cin >> offset;
-            for (uint i = 0; i < offset; ++i)
-            {
-                result_image = sc.delete_seam<SeamCarving::Orientation::HORIZONTAL>(result_image, width, height);
-            }
+            carve<SeamCarving::Orientation::HORIZONTAL>(session, offset, batch, max_cost_ratio);
         }
         else if (op.starts_with('v'))
         {
             std::cout << "Enter offset:\n";
             std::cin >> offset;
-            for (uint i = 0; i < offset; ++i)
-            {
-                result_image = sc.delete_seam<SeamCarving::Orientation::VERTICAL>(result_image, width, height);
-            }
+            carve<SeamCarving::Orientation::VERTICAL>(session, offset, batch, max_cost_ratio);
+        }
+        else if (op.starts_with('k'))
+        {
+            std::cout << "Enter seams per pass and max cost ratio (inf for none):\n";
+            std::string ratio;
+            std::cin >> batch >> ratio;
+            max_cost_ratio = std::stof(ratio);
+        }
+        else if (op.starts_with('b'))
+        {
+            std::cout << "Enter offset:\n";
+            std::cin >> offset;
+            benchmark_batches(sc, image_buffer, width, height, offset, max_cost_ratio);
+        }
+        else if (op.starts_with('r'))
+        {
+            retarget_interactive(sc, image_path, image_buffer, width, height, write_options);
+        }
+        else if (op.starts_with('t'))
+        {
+            session.tiled_cost = !session.tiled_cost;
+            std::cout << "Cost DP: " << (session.tiled_cost ? "tiled, single submission" : "per row") << ".\n";
+        }
+        else if (op.starts_with('c'))
+        {
+            std::cout << "Enter offset:\n";
+            std::cin >> offset;
+            verify_against_host(sc, image_buffer, width, height, offset, batch, max_cost_ratio);
+        }
+        else if (op.starts_with('d'))
+        {
+            dump_maps_interactive(session);
         }
         else
         {
@@ -305,11 +826,7 @@ int main(int, char **argv)
         }
     }
 
-    std::cout << "Enter output path:\n";
-    std::string output_path;
-    std::cin >> output_path;
-    std::vector<unsigned char> image_save_buffer = {};
-    lodepng::State state;
-    lodepng::encode(image_save_buffer, result_image, width, height, state);
-    lodepng::save_file(image_save_buffer, output_path);
+    std::vector<unsigned char> result_image = {};
+    session.download(result_image);
+    save_image_interactive(result_image, session.width, session.height, write_options);
 }
\ No newline at end of file
@@ -0,0 +1,1057 @@
+#pragma once
+
+#include <luisa-compute.h>
+#include <backend.h>
+#include <shadercache.h>
+#include <hostseamcarving.h>
+#include <trace.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+using namespace luisa;
+using namespace luisa::compute;
+
+struct SeamCarving
+{
+    template <typename T>
+    using prototype_t = luisa::compute::detail::definition_to_prototype_t<T>;
+    using StageTrace = lct::StageTraceScope<Stream>;
+
+    using Orientation = SeamOrientation;
+
+    // Tiled cost DP: each block of cost_tile_size threads advances cost_tile_rows rows per launch, recomputing a
+    // cost_tile_rows wide halo on both sides so that blocks never need to exchange data within a launch.
+    static constexpr uint cost_tile_size = 256u;
+    static constexpr uint cost_tile_rows = 16u;
+    static constexpr uint cost_tile_valid = cost_tile_size - 2u * cost_tile_rows;
+    static constexpr uint trace_block_size = 256u;
+    static constexpr uint scan_block_size = 256u;
+    static constexpr uint energy_tile_size = 16u;
+
+    Context &context;
+    Device device;
+    Stream stream;
+
+    Shader<1UL, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageUInt>, uint> cost_shader_vertical;
+    Shader<1UL, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageFloat>, luisa::compute::detail::definition_to_prototype_t<ImageUInt>, uint> cost_shader_horizontal;
+
+    // Session shaders. Pixels live in a tightly packed RGBA8 buffer whose row pitch is the logical width.
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<ImageFloat>, uint, uint, uint, uint, uint> energy_tile_shader;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint> remove_seam_shader_vertical;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint> remove_seam_shader_horizontal;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<ImageFloat>, prototype_t<ImageFloat>, prototype_t<BufferUInt>, uint, uint> update_energy_shader_vertical;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<ImageFloat>, prototype_t<ImageFloat>, prototype_t<BufferUInt>, uint, uint> update_energy_shader_horizontal;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageFloat>, prototype_t<ImageUInt>, uint, uint, uint> cost_shader_tiled_vertical;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageFloat>, prototype_t<ImageUInt>, uint, uint, uint> cost_shader_tiled_horizontal;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, uint, uint> trace_seam_shader_vertical;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, uint, uint> trace_seam_shader_horizontal;
+    Shader<2UL, prototype_t<ImageUInt>> clear_mask_shader;
+    Shader<1UL, prototype_t<BufferFloat>, prototype_t<BufferFloat>, prototype_t<ImageFloat>, prototype_t<ImageUInt>, uint> strip_cost_shader;
+    Shader<1UL, prototype_t<BufferFloat>> zero_shader;
+    Shader<1UL, prototype_t<BufferUInt>> iota_shader;
+    Shader<1UL, prototype_t<BufferUInt>, uint> fill_shader;
+    Shader<1UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint, uint> record_seam_shader;
+    Shader<1UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint, uint, uint> retarget_index_shader;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint, uint> retarget_shader;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint, uint, uint, float> trace_seams_shader_vertical;
+    Shader<1UL, prototype_t<ImageFloat>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint, uint, uint, float> trace_seams_shader_horizontal;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint> remove_seams_shader_vertical;
+    Shader<2UL, prototype_t<BufferUInt>, prototype_t<BufferUInt>, prototype_t<ImageUInt>, prototype_t<BufferUInt>, prototype_t<BufferUInt>, uint> remove_seams_shader_horizontal;
+
+    // `backend` is the backend used when LCT_BACKEND does not name one.
+    SeamCarving(Context &context, bool precompile = false, std::string_view backend = "cuda") : context(context)
+    {
+        device = lct::create_device(context, backend);
+        stream = device.create_stream(StreamTag::COMPUTE);
+        // Strict math keeps the session kernels bit-identical to HostSeamCarving.
+        lct::ShaderCache cache(context, device, "sc", precompile, false);
+
+        Callable luminance = [](Float4 rgba) noexcept
+        {
+            return 0.2126f * rgba.x + 0.7152f * rgba.y + 0.0722f * rgba.z;
+        };
+
+        Callable unpack_luminance = [&luminance](UInt rgba) noexcept
+        {
+            Var color = make_float4(make_uint4(rgba & 0xffu, (rgba >> 8u) & 0xffu, (rgba >> 16u) & 0xffu, rgba >> 24u)) / 255.0f;
+            return luminance(color);
+        };
+
+        // `pixels` may hold only a band of the image whose first row is image row `first_row`.
+        Callable pixel_luminance = [&unpack_luminance](BufferUInt pixels, UInt width, UInt height, Int x, Int y, UInt first_row) noexcept
+        {
+            Var cx = clamp(x, 0, cast<int>(width) - 1);
+            Var cy = clamp(y, 0, cast<int>(height) - 1);
+            return unpack_luminance(pixels.read((cast<uint>(cy) - first_row) * width + cast<uint>(cx)));
+        };
+
+        Callable pixel_energy = [&pixel_luminance](BufferUInt pixels, UInt width, UInt height, UInt2 coord, UInt first_row) noexcept
+        {
+            Var x = cast<int>(coord.x);
+            Var y = cast<int>(coord.y);
+            auto l = [&](int ox, int oy) noexcept
+            { return pixel_luminance(pixels, width, height, x + ox, y + oy, first_row); };
+            Var dx = (l(1, -1) + 2.0f * l(1, 0) + l(1, 1)) - (l(-1, -1) + 2.0f * l(-1, 0) + l(-1, 1));
+            Var dy = (l(-1, 1) + 2.0f * l(0, 1) + l(1, 1)) - (l(-1, -1) + 2.0f * l(0, -1) + l(1, -1));
+            return luisa::compute::sqrt(dx * dx + dy * dy);
+        };
+
+        // Sobel energy of image rows [out_row, out_row + rows) from a band of pixels starting at image row first_row.
+        // Each 16x16 block stages the luminance of its pixels plus a one-pixel apron in shared memory, so every
+        // packed texel is fetched and converted once instead of nine times. Dispatch in whole blocks.
+        Kernel2D energy_tile_kernel = [&unpack_luminance](BufferUInt pixels, ImageFloat out, UInt width, UInt height, UInt first_row, UInt out_row, UInt rows) noexcept
+        {
+            set_block_size(energy_tile_size, energy_tile_size, 1u);
+            constexpr uint apron = energy_tile_size + 2u;
+            Shared<float> tile{apron * apron};
+            Var local = thread_id().xy();
+            Var corner = make_int2(block_id().xy() * energy_tile_size) - 1;
+            Var last_row = min(out_row + rows, height - 1u);
+            $for(k, local.y * energy_tile_size + local.x, apron * apron, energy_tile_size * energy_tile_size)
+            {
+                Var x = clamp(corner.x + cast<int>(k % apron), 0, cast<int>(width) - 1);
+                Var y = clamp(cast<int>(out_row) + corner.y + cast<int>(k / apron), cast<int>(first_row), cast<int>(last_row));
+                tile[k] = unpack_luminance(pixels.read((cast<uint>(y) - first_row) * width + cast<uint>(x)));
+            };
+            sync_block();
+            Var coord = dispatch_id().xy();
+            $if(coord.x < width && coord.y < rows)
+            {
+                auto l = [&](int ox, int oy) noexcept
+                { return tile[(cast<int>(local.y) + 1 + oy) * static_cast<int>(apron) + cast<int>(local.x) + 1 + ox]; };
+                Var dx = (l(1, -1) + 2.0f * l(1, 0) + l(1, 1)) - (l(-1, -1) + 2.0f * l(-1, 0) + l(-1, 1));
+                Var dy = (l(-1, 1) + 2.0f * l(0, 1) + l(1, 1)) - (l(-1, -1) + 2.0f * l(0, -1) + l(1, -1));
+                out.write(coord, make_float4(make_float3(luisa::compute::sqrt(dx * dx + dy * dy)), 1.0f));
+            };
+        };
+
+        // Out-of-core strips: one cost row at a time, carried between strips in a frontier buffer.
+        Kernel1D strip_cost_kernel = [](BufferFloat previous, BufferFloat current, ImageFloat energy_map, ImageUInt pred_map, UInt row) noexcept
+        {
+            Var x = dispatch_id().x;
+            Float lt = std::numeric_limits<float>::infinity();
+            Float rt = std::numeric_limits<float>::infinity();
+            $if(x > 0)
+            {
+                lt = previous.read(x - 1u);
+            };
+            $if(x + 1 < dispatch_size_x())
+            {
+                rt = previous.read(x + 1u);
+            };
+            Var best = previous.read(x);
+            UInt pred = 1u;
+            $if(lt < best)
+            {
+                best = lt;
+                pred = 0u;
+            };
+            $if(rt < best)
+            {
+                best = rt;
+                pred = 2u;
+            };
+            current.write(x, energy_map.read(make_uint2(x, row)).x + best);
+            pred_map.write(make_uint2(x, row), make_uint4(pred));
+        };
+
+        Kernel1D zero_kernel = [](BufferFloat buffer) noexcept
+        {
+            buffer.write(dispatch_id().x, 0.0f);
+        };
+
+        // Dispatched over the shrunk extent; every output pixel gathers from the left/top of the seam or one past it.
+        Kernel2D remove_seam_kernel_vertical = [](BufferUInt src, BufferUInt dst, BufferUInt seam, UInt width) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            Var x = coord.x + ite(coord.x >= seam.read(coord.y), 1u, 0u);
+            dst.write(coord.y * (width - 1u) + coord.x, src.read(coord.y * width + x));
+        };
+
+        Kernel2D remove_seam_kernel_horizontal = [](BufferUInt src, BufferUInt dst, BufferUInt seam, UInt width) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            Var y = coord.y + ite(coord.y >= seam.read(coord.x), 1u, 0u);
+            dst.write(coord.y * width + coord.x, src.read(y * width + coord.x));
+        };
+
+        // Incremental energy update after a seam removal, dispatched over the shrunk extent of the already
+        // compacted pixels. A pixel's 3x3 Sobel window only changes if it lies in [seam - 2, seam + 1] of its
+        // row (column), since the seam moves by at most one pixel per step; everything else is shifted over.
+        Kernel2D update_energy_kernel_vertical = [&pixel_energy](BufferUInt pixels, ImageFloat src, ImageFloat dst, BufferUInt seam, UInt width, UInt height) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            Var s = cast<int>(seam.read(coord.y));
+            Var x = cast<int>(coord.x);
+            $if(x >= s - 2 && x <= s + 1)
+            {
+                dst.write(coord, make_float4(make_float3(pixel_energy(pixels, width, height, coord, 0u)), 1.0f));
+            }
+            $else
+            {
+                dst.write(coord, src.read(make_uint2(coord.x + ite(x >= s, 1u, 0u), coord.y)));
+            };
+        };
+
+        Kernel2D update_energy_kernel_horizontal = [&pixel_energy](BufferUInt pixels, ImageFloat src, ImageFloat dst, BufferUInt seam, UInt width, UInt height) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            Var s = cast<int>(seam.read(coord.x));
+            Var y = cast<int>(coord.y);
+            $if(y >= s - 2 && y <= s + 1)
+            {
+                dst.write(coord, make_float4(make_float3(pixel_energy(pixels, width, height, coord, 0u)), 1.0f));
+            }
+            $else
+            {
+                dst.write(coord, src.read(make_uint2(coord.x, coord.y + ite(y >= s, 1u, 0u))));
+            };
+        };
+
+        // The predecessor map stores 1 + the offset (-1, 0 or +1) of the cheapest neighbour in the previous row
+        // (column); ties prefer the straight neighbour, then the left (upper) one.
+        Kernel1D cost_kernel_vertical = [](ImageFloat cost_map, ImageFloat energy_map, ImageUInt pred_map, UInt y) noexcept
+        {
+            Var x = dispatch_id().x;
+            Float lt = std::numeric_limits<float>::infinity();
+            Float t = cost_map.read(make_uint2(x, y - 1)).x;
+            Float rt = std::numeric_limits<float>::infinity();
+            $if(x > 0)
+            {
+                lt = cost_map.read(make_uint2(x - 1, y - 1)).x;
+            };
+            $if(x + 1 < dispatch_size_x())
+            {
+                rt = cost_map.read(make_uint2(x + 1, y - 1)).x;
+            };
+            Var best = t;
+            UInt pred = 1u;
+            $if(lt < best)
+            {
+                best = lt;
+                pred = 0u;
+            };
+            $if(rt < best)
+            {
+                best = rt;
+                pred = 2u;
+            };
+            Var cost = energy_map.read(make_uint2(x, y)).x + best;
+            cost_map.write(make_uint2(x, y), make_float4(make_float3(cost), 1.0f));
+            pred_map.write(make_uint2(x, y), make_uint4(pred));
+        };
+
+        Kernel1D cost_kernel_horizontal = [](ImageFloat cost_map, ImageFloat energy_map, ImageUInt pred_map, UInt x) noexcept
+        {
+            Var y = dispatch_id().x;
+            Float lt = std::numeric_limits<float>::infinity();
+            Float t = cost_map.read(make_uint2(x - 1, y)).x;
+            Float rt = std::numeric_limits<float>::infinity();
+            $if(y > 0)
+            {
+                lt = cost_map.read(make_uint2(x - 1, y - 1)).x;
+            };
+            $if(y + 1 < dispatch_size_x())
+            {
+                rt = cost_map.read(make_uint2(x - 1, y + 1)).x;
+            };
+            Var best = t;
+            UInt pred = 1u;
+            $if(lt < best)
+            {
+                best = lt;
+                pred = 0u;
+            };
+            $if(rt < best)
+            {
+                best = rt;
+                pred = 2u;
+            };
+            Var cost = energy_map.read(make_uint2(x, y)).x + best;
+            cost_map.write(make_uint2(x, y), make_float4(make_float3(cost), 1.0f));
+            pred_map.write(make_uint2(x, y), make_uint4(pred));
+        };
+
+        // Rows (columns) [first, first + rows) of the cumulative cost map in one launch. "across" is the extent the
+        // seam crosses, i.e. the width for vertical seams and the height for horizontal ones.
+        auto make_tiled_cost_kernel = [](Orientation o) noexcept
+        {
+            return Kernel1D{[o](ImageFloat cost_map, ImageFloat energy_map, ImageUInt pred_map, UInt first, UInt rows, UInt across) noexcept
+                            {
+                                set_block_size(cost_tile_size, 1u, 1u);
+                                auto texel = [o](Expr<uint> i, Expr<uint> j) noexcept
+                                { return o == Orientation::VERTICAL ? make_uint2(i, j) : make_uint2(j, i); };
+                                Shared<float> tile{cost_tile_size};
+                                Var t = thread_id().x;
+                                Var i = cast<int>(block_id().x * cost_tile_valid + t) - static_cast<int>(cost_tile_rows);
+                                Var inside = i >= 0 && i < cast<int>(across);
+                                Var ui = cast<uint>(max(i, 0));
+                                tile[t] = std::numeric_limits<float>::infinity();
+                                $if(inside)
+                                {
+                                    $if(first == 0u)
+                                    {
+                                        tile[t] = 0.0f;
+                                    }
+                                    $else
+                                    {
+                                        tile[t] = cost_map.read(texel(ui, first - 1u)).x;
+                                    };
+                                };
+                                sync_block();
+                                $for(r, rows)
+                                {
+                                    Var j = first + r;
+                                    Float cost = std::numeric_limits<float>::infinity();
+                                    UInt pred = 1u;
+                                    $if(inside)
+                                    {
+                                        Float lt = std::numeric_limits<float>::infinity();
+                                        Float rt = std::numeric_limits<float>::infinity();
+                                        $if(t > 0u)
+                                        {
+                                            lt = tile[t - 1u];
+                                        };
+                                        $if(t + 1u < cost_tile_size)
+                                        {
+                                            rt = tile[t + 1u];
+                                        };
+                                        Float best = tile[t];
+                                        $if(lt < best)
+                                        {
+                                            best = lt;
+                                            pred = 0u;
+                                        };
+                                        $if(rt < best)
+                                        {
+                                            best = rt;
+                                            pred = 2u;
+                                        };
+                                        cost = energy_map.read(texel(ui, j)).x + best;
+                                    };
+                                    sync_block();
+                                    tile[t] = cost;
+                                    sync_block();
+                                    $if(inside && t >= cost_tile_rows && t < cost_tile_size - cost_tile_rows)
+                                    {
+                                        cost_map.write(texel(ui, j), make_float4(make_float3(cost), 1.0f));
+                                        pred_map.write(texel(ui, j), make_uint4(pred));
+                                    };
+                                };
+                            }};
+        };
+        auto cost_kernel_tiled_vertical = make_tiled_cost_kernel(Orientation::VERTICAL);
+        auto cost_kernel_tiled_horizontal = make_tiled_cost_kernel(Orientation::HORIZONTAL);
+
+        // One block: argmin over the last row (column) of the cost map, first index on ties, followed by a
+        // single-thread walk through the predecessor map. Only the seam buffer is written.
+        auto make_trace_seam_kernel = [](Orientation o) noexcept
+        {
+            return Kernel1D{[o](ImageFloat cost_map, ImageUInt pred_map, BufferUInt seam, UInt across, UInt along) noexcept
+                            {
+                                set_block_size(trace_block_size, 1u, 1u);
+                                auto texel = [o](Expr<uint> i, Expr<uint> j) noexcept
+                                { return o == Orientation::VERTICAL ? make_uint2(i, j) : make_uint2(j, i); };
+                                Shared<float> best_cost{trace_block_size};
+                                Shared<uint> best_index{trace_block_size};
+                                Var t = thread_id().x;
+                                Float cost = std::numeric_limits<float>::infinity();
+                                UInt index = ~0u;
+                                $for(i, t, across, trace_block_size)
+                                {
+                                    Var c = cost_map.read(texel(i, along - 1u)).x;
+                                    $if(c < cost)
+                                    {
+                                        cost = c;
+                                        index = i;
+                                    };
+                                };
+                                best_cost[t] = cost;
+                                best_index[t] = index;
+                                sync_block();
+                                for (uint stride = trace_block_size / 2u; stride > 0u; stride /= 2u)
+                                {
+                                    $if(t < stride)
+                                    {
+                                        Var other_cost = best_cost[t + stride];
+                                        Var other_index = best_index[t + stride];
+                                        $if(other_cost < best_cost[t] || (other_cost == best_cost[t] && other_index < best_index[t]))
+                                        {
+                                            best_cost[t] = other_cost;
+                                            best_index[t] = other_index;
+                                        };
+                                    };
+                                    sync_block();
+                                }
+                                $if(t == 0u)
+                                {
+                                    UInt i = ite(best_index[0u] == ~0u, 0u, best_index[0u]);
+                                    seam.write(along - 1u, i);
+                                    $for(k, 1u, along)
+                                    {
+                                        Var j = along - k;
+                                        i = i + pred_map.read(texel(i, j)).x - 1u;
+                                        seam.write(j - 1u, i);
+                                    };
+                                };
+                            }};
+        };
+        auto trace_seam_kernel_vertical = make_trace_seam_kernel(Orientation::VERTICAL);
+        auto trace_seam_kernel_horizontal = make_trace_seam_kernel(Orientation::HORIZONTAL);
+
+        Kernel2D clear_mask_kernel = [](ImageUInt mask) noexcept
+        {
+            mask.write(dispatch_id().xy(), make_uint4(0u));
+        };
+
+        Kernel1D iota_kernel = [](BufferUInt buffer) noexcept
+        {
+            buffer.write(dispatch_id().x, dispatch_id().x);
+        };
+
+        Kernel1D fill_kernel = [](BufferUInt buffer, UInt value) noexcept
+        {
+            buffer.write(dispatch_id().x, value);
+        };
+
+        // Dispatched over the rows of a vertical seam: stamps the carving step on the source pixel each row loses.
+        Kernel1D record_seam_kernel = [](BufferUInt origin, BufferUInt order, BufferUInt seam, UInt width, UInt step) noexcept
+        {
+            Var y = dispatch_id().x;
+            order.write(origin.read(y * width + seam.read(y)), step);
+        };
+
+        // One block per row builds the row's target-to-source column index for the pixels that survive the first
+        // `removed` carving steps: each thread counts the survivors of a contiguous chunk, the block scans the
+        // counts, and each thread then writes its survivors at their exclusive offsets.
+        Kernel1D retarget_index_kernel = [](BufferUInt order, BufferUInt index, UInt width, UInt target_width, UInt removed) noexcept
+        {
+            set_block_size(scan_block_size, 1u, 1u);
+            Shared<uint> counts{scan_block_size};
+            Var y = block_id().x;
+            Var t = thread_id().x;
+            Var chunk = (width + scan_block_size - 1u) / scan_block_size;
+            Var begin = min(t * chunk, width);
+            Var end = min(begin + chunk, width);
+            UInt n = 0u;
+            $for(x, begin, end)
+            {
+                $if(order.read(y * width + x) >= removed)
+                {
+                    n += 1u;
+                };
+            };
+            counts[t] = n;
+            sync_block();
+            for (uint stride = 1u; stride < scan_block_size; stride *= 2u)
+            {
+                UInt other = 0u;
+                $if(t >= stride)
+                {
+                    other = counts[t - stride];
+                };
+                sync_block();
+                counts[t] = counts[t] + other;
+                sync_block();
+            }
+            UInt column = counts[t] - n;
+            $for(x, begin, end)
+            {
+                $if(order.read(y * width + x) >= removed)
+                {
+                    index.write(y * target_width + column, x);
+                    column += 1u;
+                };
+            };
+        };
+
+        // One thread per target pixel gathers its source pixel through the index.
+        Kernel2D retarget_kernel = [](BufferUInt source, BufferUInt index, BufferUInt target, UInt width, UInt target_width) noexcept
+        {
+            Var p = dispatch_id().xy();
+            Var i = p.y * target_width + p.x;
+            target.write(i, source.read(p.y * width + index.read(i)));
+        };
+
+        // Single thread: repeatedly starts at the cheapest unused end point and backtracks through the cost map,
+        // never stepping onto a pixel already taken by an earlier seam. seams[s * along + j] is seam s at row j.
+        auto make_trace_seams_kernel = [](Orientation o) noexcept
+        {
+            return Kernel1D{[o](ImageFloat cost_map, ImageUInt mask, BufferUInt seams, BufferUInt count, UInt across, UInt along, UInt k, Float max_cost_ratio) noexcept
+                            {
+                                auto texel = [o](Expr<uint> i, Expr<uint> j) noexcept
+                                { return o == Orientation::VERTICAL ? make_uint2(i, j) : make_uint2(j, i); };
+                                auto is_free = [&](Expr<uint> i, Expr<uint> j) noexcept
+                                { return mask.read(texel(i, j)).x == 0u; };
+                                UInt found = 0u;
+                                Float first_cost = std::numeric_limits<float>::infinity();
+                                $while(found < k)
+                                {
+                                    Float best = std::numeric_limits<float>::infinity();
+                                    UInt start = ~0u;
+                                    $for(i, across)
+                                    {
+                                        $if(is_free(i, along - 1u))
+                                        {
+                                            Var c = cost_map.read(texel(i, along - 1u)).x;
+                                            $if(c < best)
+                                            {
+                                                best = c;
+                                                start = i;
+                                            };
+                                        };
+                                    };
+                                    $if(start == ~0u || (found > 0u && best > max(first_cost, HostSeamCarving::seam_cost_floor) * max_cost_ratio))
+                                    {
+                                        $break;
+                                    };
+                                    $if(found == 0u)
+                                    {
+                                        first_cost = best;
+                                    };
+                                    Var base = found * along;
+                                    UInt i = start;
+                                    Bool blocked = false;
+                                    seams.write(base + along - 1u, i);
+                                    $for(r, 1u, along)
+                                    {
+                                        Var j = along - r;
+                                        Float best_cost = std::numeric_limits<float>::infinity();
+                                        UInt best_index = ~0u;
+                                        $if(is_free(i, j - 1u))
+                                        {
+                                            best_cost = cost_map.read(texel(i, j - 1u)).x;
+                                            best_index = i;
+                                        };
+                                        $if(i > 0u)
+                                        {
+                                            $if(is_free(i - 1u, j - 1u))
+                                            {
+                                                Var c = cost_map.read(texel(i - 1u, j - 1u)).x;
+                                                $if(c < best_cost)
+                                                {
+                                                    best_cost = c;
+                                                    best_index = i - 1u;
+                                                };
+                                            };
+                                        };
+                                        $if(i + 1u < across)
+                                        {
+                                            $if(is_free(i + 1u, j - 1u))
+                                            {
+                                                Var c = cost_map.read(texel(i + 1u, j - 1u)).x;
+                                                $if(c < best_cost)
+                                                {
+                                                    best_cost = c;
+                                                    best_index = i + 1u;
+                                                };
+                                            };
+                                        };
+                                        $if(best_index == ~0u)
+                                        {
+                                            blocked = true;
+                                            $break;
+                                        };
+                                        i = best_index;
+                                        seams.write(base + j - 1u, i);
+                                    };
+                                    $if(blocked)
+                                    {
+                                        mask.write(texel(start, along - 1u), make_uint4(2u));
+                                    }
+                                    $else
+                                    {
+                                        $for(j, along)
+                                        {
+                                            mask.write(texel(seams.read(base + j), j), make_uint4(1u));
+                                        };
+                                        found += 1u;
+                                    };
+                                };
+                                count.write(0u, found);
+                            }};
+        };
+        auto trace_seams_kernel_vertical = make_trace_seams_kernel(Orientation::VERTICAL);
+        auto trace_seams_kernel_horizontal = make_trace_seams_kernel(Orientation::HORIZONTAL);
+
+        // Dispatched over the old extent: every kept pixel moves back by the number of removed seams before it.
+        Kernel2D remove_seams_kernel_vertical = [](BufferUInt src, BufferUInt dst, ImageUInt mask, BufferUInt seams, BufferUInt count, UInt width) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            $if(mask.read(coord).x != 1u)
+            {
+                Var n = count.read(0u);
+                UInt shift = 0u;
+                $for(s, n)
+                {
+                    $if(seams.read(s * dispatch_size_y() + coord.y) < coord.x)
+                    {
+                        shift += 1u;
+                    };
+                };
+                dst.write(coord.y * (width - n) + coord.x - shift, src.read(coord.y * width + coord.x));
+            };
+        };
+
+        Kernel2D remove_seams_kernel_horizontal = [](BufferUInt src, BufferUInt dst, ImageUInt mask, BufferUInt seams, BufferUInt count, UInt width) noexcept
+        {
+            Var coord = dispatch_id().xy();
+            $if(mask.read(coord).x != 1u)
+            {
+                Var n = count.read(0u);
+                UInt shift = 0u;
+                $for(s, n)
+                {
+                    $if(seams.read(s * width + coord.x) < coord.y)
+                    {
+                        shift += 1u;
+                    };
+                };
+                dst.write((coord.y - shift) * width + coord.x, src.read(coord.y * width + coord.x));
+            };
+        };
+
+        cost_shader_vertical = cache.compile(cost_kernel_vertical, "cost_vertical");
+        cost_shader_horizontal = cache.compile(cost_kernel_horizontal, "cost_horizontal");
+        energy_tile_shader = cache.compile(energy_tile_kernel, "energy_tile");
+        remove_seam_shader_vertical = cache.compile(remove_seam_kernel_vertical, "remove_seam_vertical");
+        remove_seam_shader_horizontal = cache.compile(remove_seam_kernel_horizontal, "remove_seam_horizontal");
+        update_energy_shader_vertical = cache.compile(update_energy_kernel_vertical, "update_energy_vertical");
+        update_energy_shader_horizontal = cache.compile(update_energy_kernel_horizontal, "update_energy_horizontal");
+        cost_shader_tiled_vertical = cache.compile(cost_kernel_tiled_vertical, "cost_tiled_vertical");
+        cost_shader_tiled_horizontal = cache.compile(cost_kernel_tiled_horizontal, "cost_tiled_horizontal");
+        trace_seam_shader_vertical = cache.compile(trace_seam_kernel_vertical, "trace_seam_vertical");
+        trace_seam_shader_horizontal = cache.compile(trace_seam_kernel_horizontal, "trace_seam_horizontal");
+        clear_mask_shader = cache.compile(clear_mask_kernel, "clear_mask");
+        strip_cost_shader = cache.compile(strip_cost_kernel, "strip_cost");
+        zero_shader = cache.compile(zero_kernel, "zero");
+        iota_shader = cache.compile(iota_kernel, "iota");
+        fill_shader = cache.compile(fill_kernel, "fill");
+        record_seam_shader = cache.compile(record_seam_kernel, "record_seam");
+        retarget_index_shader = cache.compile(retarget_index_kernel, "retarget_index");
+        retarget_shader = cache.compile(retarget_kernel, "retarget");
+        trace_seams_shader_vertical = cache.compile(trace_seams_kernel_vertical, "trace_seams_vertical");
+        trace_seams_shader_horizontal = cache.compile(trace_seams_kernel_horizontal, "trace_seams_horizontal");
+        remove_seams_shader_vertical = cache.compile(remove_seams_kernel_vertical, "remove_seams_vertical");
+        remove_seams_shader_horizontal = cache.compile(remove_seams_kernel_horizontal, "remove_seams_horizontal");
+        cache.report();
+    }
+
+    // A carving session keeps the working image, its energy and cost maps on the device for its whole lifetime.
+    // Removing a seam only shrinks the logical extent; pixels are read back on demand.
+    struct Session
+    {
+        SeamCarving &sc;
+        Stream &stream;
+        uint width;
+        uint height;
+        std::array<Buffer<uint>, 2> pixels;
+        uint front = 0u;
+        std::array<Image<float>, 2> image_energy;
+        uint energy_front = 0u;
+        // When set, the energy map is carried over between seams and only refreshed around the removed seam.
+        bool incremental_energy = true;
+        bool energy_valid = false;
+        // When set, the whole cost DP goes out as a single command list of tiled launches; otherwise one
+        // dispatch plus synchronize per row (column), as in the legacy path.
+        bool tiled_cost = true;
+        Image<float> image_cost;
+        Image<uint> image_pred;
+        Buffer<uint> seam_buffer;
+        // Batch removal state: 1 marks a pixel taken by a seam, 2 a last-row start that could not be traced.
+        Image<uint> image_mask;
+        Buffer<uint> seams_buffer;
+        Buffer<uint> seam_count;
+        // Seam order recording: origin maps the current layout back to source pixel indices and order holds the
+        // vertical carving step that removed each source pixel, ~0u for survivors.
+        std::array<Buffer<uint>, 2> origin;
+        Buffer<uint> order;
+        uint order_steps = 0u;
+
+        // Energy and cost are single-channel. half_energy stores the energy map as HALF1; the cumulative cost stays
+        // FLOAT1 since its magnitude grows with the image extent and would lose too much precision.
+        // Commands go to the given stream, so several sessions can carve concurrently on their own streams.
+        Session(SeamCarving &sc, Stream &stream, const unsigned char *image_buffer, uint width, uint height, bool half_energy = false)
+            : sc(sc), stream(stream), width(width), height(height)
+        {
+            auto &device = sc.device;
+            const auto energy_storage = half_energy ? PixelStorage::HALF1 : PixelStorage::FLOAT1;
+            pixels[0] = device.create_buffer<uint>(width * height);
+            pixels[1] = device.create_buffer<uint>(width * height);
+            image_energy[0] = device.create_image<float>(energy_storage, width, height, 0u);
+            image_energy[1] = device.create_image<float>(energy_storage, width, height, 0u);
+            image_cost = device.create_image<float>(PixelStorage::FLOAT1, width, height, 0u);
+            image_pred = device.create_image<uint>(PixelStorage::BYTE1, width, height, 0u);
+            seam_buffer = device.create_buffer<uint>(std::max(width, height));
+            image_mask = device.create_image<uint>(PixelStorage::BYTE1, width, height, 0u);
+            seam_count = device.create_buffer<uint>(1u);
+            stream << pixels[front].copy_from(image_buffer) << synchronize();
+        }
+
+        Session(SeamCarving &sc, const unsigned char *image_buffer, uint width, uint height, bool half_energy = false)
+            : Session(sc, sc.stream, image_buffer, width, height, half_energy) {}
+
+        void record_order()
+        {
+            auto &device = sc.device;
+            origin[0] = device.create_buffer<uint>(width * height);
+            origin[1] = device.create_buffer<uint>(width * height);
+            order = device.create_buffer<uint>(width * height);
+            order_steps = 0u;
+            stream << sc.iota_shader(origin[front]).dispatch(width * height)
+                      << sc.fill_shader(order, ~0u).dispatch(width * height);
+        }
+
+        // Energy (if stale) and the cumulative cost and predecessor maps for the current extent. No sync.
+        template <Orientation _O>
+        void compute_cost()
+        {
+            auto &energy = image_energy[energy_front];
+            if (!incremental_energy || !energy_valid)
+            {
+                StageTrace stage(stream, "energy");
+                stream << sc.compute_energy(pixels[front], energy, width, height, 0u, 0u, height);
+                energy_valid = true;
+            }
+            StageTrace stage(stream, tiled_cost ? "cost (tiled)" : "cost (per row)");
+            // The first tiled launch seeds row (column) 0 with the energy itself, so energy and cost may differ in storage.
+            const uint across = _O == Orientation::VERTICAL ? width : height;
+            const uint along = _O == Orientation::VERTICAL ? height : width;
+            auto &tiled_shader = _O == Orientation::VERTICAL ? sc.cost_shader_tiled_vertical : sc.cost_shader_tiled_horizontal;
+            const uint blocks = (across + cost_tile_valid - 1u) / cost_tile_valid;
+            if (tiled_cost)
+            {
+                CommandList cmds;
+                cmds.reserve((along + cost_tile_rows - 1u) / cost_tile_rows, 0u);
+                for (uint first = 0u; first < along; first += cost_tile_rows)
+                    cmds << tiled_shader(image_cost, energy, image_pred, first, std::min(cost_tile_rows, along - first), across).dispatch(blocks * cost_tile_size);
+                stream << cmds.commit();
+                return;
+            }
+            stream << tiled_shader(image_cost, energy, image_pred, 0u, 1u, across).dispatch(blocks * cost_tile_size);
+            if constexpr (_O == Orientation::VERTICAL)
+            {
+                for (uint y = 1; y < height; ++y)
+                    stream << sc.cost_shader_vertical(image_cost, energy, image_pred, y).dispatch(width) << synchronize();
+            }
+            else
+            {
+                for (uint x = 1; x < width; ++x)
+                    stream << sc.cost_shader_horizontal(image_cost, energy, image_pred, x).dispatch(height) << synchronize();
+            }
+        }
+
+        // Does nothing once a single row or column is left.
+        template <Orientation _O = Orientation::VERTICAL>
+        void delete_seam()
+        {
+            if ((_O == Orientation::VERTICAL ? width : height) <= 1u)
+                return;
+            auto &energy = image_energy[energy_front];
+            compute_cost<_O>();
+            {
+                StageTrace stage(stream, "trace seam");
+                if constexpr (_O == Orientation::VERTICAL)
+                    stream << sc.trace_seam_shader_vertical(image_cost, image_pred, seam_buffer, width, height).dispatch(trace_block_size);
+                else
+                    stream << sc.trace_seam_shader_horizontal(image_cost, image_pred, seam_buffer, height, width).dispatch(trace_block_size);
+            }
+
+            StageTrace stage(stream, "remove seam");
+            auto &src = pixels[front];
+            auto &dst = pixels[front ^ 1u];
+            if constexpr (_O == Orientation::VERTICAL)
+            {
+                stream << sc.remove_seam_shader_vertical(src, dst, seam_buffer, width).dispatch(width - 1u, height);
+                if (order)
+                {
+                    stream << sc.record_seam_shader(origin[front], order, seam_buffer, width, order_steps++).dispatch(height)
+                           << sc.remove_seam_shader_vertical(origin[front], origin[front ^ 1u], seam_buffer, width).dispatch(width - 1u, height);
+                }
+                --width;
+                if (incremental_energy)
+                    stream << sc.update_energy_shader_vertical(dst, energy, image_energy[energy_front ^ 1u], seam_buffer, width, height).dispatch(width, height);
+            }
+            else
+            {
+                LUISA_ASSERT(!order, "Seam order recording only supports vertical seams.");
+                stream << sc.remove_seam_shader_horizontal(src, dst, seam_buffer, width).dispatch(width, height - 1u);
+                --height;
+                if (incremental_energy)
+                    stream << sc.update_energy_shader_horizontal(dst, energy, image_energy[energy_front ^ 1u], seam_buffer, width, height).dispatch(width, height);
+            }
+            stream << synchronize();
+            front ^= 1u;
+            if (incremental_energy)
+                energy_front ^= 1u;
+            else
+                energy_valid = false;
+        }
+
+        // Removes up to k pixel-disjoint seams found in a single cost map and returns how many were removed.
+        // Seams after the first are only accepted while their cost stays within max_cost_ratio times the
+        // cheapest one (or HostSeamCarving::seam_cost_floor, if that is larger), so a ratio of 1 degenerates to
+        // one-at-a-time carving and infinity always takes k.
+        template <Orientation _O = Orientation::VERTICAL>
+        uint delete_seams(uint k, float max_cost_ratio = std::numeric_limits<float>::infinity())
+        {
+            const uint across = _O == Orientation::VERTICAL ? width : height;
+            const uint along = _O == Orientation::VERTICAL ? height : width;
+            LUISA_ASSERT(!order, "Seam order recording requires one seam per pass.");
+            k = std::min(k, across - 1u);
+            if (k == 0u)
+                return 0u;
+            if (seams_buffer.size() < k * along)
+                seams_buffer = sc.device.create_buffer<uint>(k * along);
+            compute_cost<_O>();
+            StageTrace stage(stream, "trace and remove seams");
+            stream << sc.clear_mask_shader(image_mask).dispatch(width, height);
+            auto &src = pixels[front];
+            auto &dst = pixels[front ^ 1u];
+            if constexpr (_O == Orientation::VERTICAL)
+            {
+                stream << sc.trace_seams_shader_vertical(image_cost, image_mask, seams_buffer, seam_count, across, along, k, max_cost_ratio).dispatch(1u)
+                       << sc.remove_seams_shader_vertical(src, dst, image_mask, seams_buffer, seam_count, width).dispatch(width, height);
+            }
+            else
+            {
+                stream << sc.trace_seams_shader_horizontal(image_cost, image_mask, seams_buffer, seam_count, across, along, k, max_cost_ratio).dispatch(1u)
+                       << sc.remove_seams_shader_horizontal(src, dst, image_mask, seams_buffer, seam_count, width).dispatch(width, height);
+            }
+            uint count = 0u;
+            stream << seam_count.copy_to(&count) << synchronize();
+            if constexpr (_O == Orientation::VERTICAL)
+                width -= count;
+            else
+                height -= count;
+            front ^= 1u;
+            energy_valid = false;
+            return count;
+        }
+
+        void download(std::vector<unsigned char> &image_buffer)
+        {
+            image_buffer.resize(width * height * 4u);
+            StageTrace stage(stream, "download");
+            stream << pixels[front].view(0u, width * height).copy_to(image_buffer.data()) << synchronize();
+        }
+
+        // Energy and vertical cumulative cost of the current extent, row-major, for debug dumps. The energy is left
+        // empty when it is stored in half precision.
+        void download_maps(std::vector<float> &energy, std::vector<float> &cost)
+        {
+            compute_cost<Orientation::VERTICAL>();
+            const auto &energy_map = image_energy[energy_front];
+            const auto size = image_cost.size();
+            const bool float_energy = energy_map.storage() == PixelStorage::FLOAT1;
+            std::vector<float> full_energy(float_energy ? size.x * size.y : 0u);
+            std::vector<float> full_cost(size.x * size.y);
+            stream << image_cost.copy_to(full_cost.data());
+            if (float_energy)
+                stream << energy_map.copy_to(full_energy.data());
+            stream << synchronize();
+            auto crop = [&](const std::vector<float> &full, std::vector<float> &out)
+            {
+                out.resize(full.empty() ? 0u : width * height);
+                for (uint y = 0u; y < height && !full.empty(); ++y)
+                    std::copy_n(full.begin() + y * size.x, width, out.begin() + y * width);
+            };
+            crop(full_energy, energy);
+            crop(full_cost, cost);
+        }
+    };
+
+    [[nodiscard]] static uint align_up(uint x, uint alignment) noexcept { return (x + alignment - 1u) / alignment * alignment; }
+
+    [[nodiscard]] auto compute_energy(const Buffer<uint> &pixels, const Image<float> &energy, uint width, uint height, uint first_row, uint out_row, uint rows)
+    {
+        return energy_tile_shader(pixels, energy, width, height, first_row, out_row, rows).dispatch(align_up(width, energy_tile_size), align_up(rows, energy_tile_size));
+    }
+
+    // Carves a source image once down to min_width and keeps, for every source pixel, the step that removed it.
+    // Any width in [min_width, width] is then a per-row scan of the order map followed by a per-pixel gather.
+    struct Retargeter
+    {
+        SeamCarving &sc;
+        uint width;
+        uint height;
+        uint min_width;
+        Buffer<uint> source;
+        Buffer<uint> order;
+        Buffer<uint> index;
+        Buffer<uint> target;
+
+        Retargeter(SeamCarving &sc, const unsigned char *image_buffer, uint width, uint height, uint min_width)
+            : sc(sc), width(width), height(height), min_width(min_width)
+        {
+            {
+                Session session(sc, image_buffer, width, height);
+                session.record_order();
+                for (uint i = min_width; i < width; ++i)
+                    session.delete_seam<Orientation::VERTICAL>();
+                order = std::move(session.order);
+            }
+            allocate(image_buffer);
+        }
+
+        Retargeter(SeamCarving &sc, const unsigned char *image_buffer, uint width, uint height, uint min_width, const std::vector<uint> &host_order)
+            : sc(sc), width(width), height(height), min_width(min_width)
+        {
+            order = sc.device.create_buffer<uint>(width * height);
+            sc.stream << order.copy_from(host_order.data());
+            allocate(image_buffer);
+        }
+
+        void allocate(const unsigned char *image_buffer)
+        {
+            source = sc.device.create_buffer<uint>(width * height);
+            index = sc.device.create_buffer<uint>(width * height);
+            target = sc.device.create_buffer<uint>(width * height);
+            sc.stream << source.copy_from(image_buffer) << synchronize();
+        }
+
+        void retarget(uint target_width, std::vector<unsigned char> &image_buffer)
+        {
+            target_width = std::clamp(target_width, min_width, width);
+            image_buffer.resize(target_width * height * 4u);
+            sc.stream << sc.retarget_index_shader(order, index, width, target_width, width - target_width).dispatch(height * scan_block_size)
+                      << sc.retarget_shader(source, index, target, width, target_width).dispatch(target_width, height)
+                      << target.view(0u, target_width * height).copy_to(image_buffer.data()) << synchronize();
+        }
+
+        void download_order(std::vector<uint> &host_order)
+        {
+            host_order.resize(width * height);
+            sc.stream << order.copy_to(host_order.data()) << synchronize();
+        }
+    };
+
+    // Out-of-core vertical carving for images that do not fit on the device. The image stays on the host and is
+    // streamed through in strips of strip_rows rows plus a one-row halo; the cost DP carries a single frontier
+    // row from strip to strip and each strip's predecessor map is spilled to host memory, or to spill_path
+    // when set. Device memory is bounded by the strip size.
+    struct StreamingCarver
+    {
+        SeamCarving &sc;
+        std::vector<unsigned char> &image_buffer;
+        uint width;
+        uint height;
+        uint strip_rows;
+        uint stride;
+        Buffer<uint> strip_pixels;
+        Image<float> strip_energy;
+        Image<uint> strip_pred;
+        std::array<Buffer<float>, 2> frontier;
+        std::vector<unsigned char> host_pred;
+        std::fstream spill;
+        std::vector<float> host_frontier;
+        std::vector<uint> seam;
+
+        StreamingCarver(SeamCarving &sc, std::vector<unsigned char> &image_buffer, uint width, uint height, uint strip_rows, const std::string &spill_path = {})
+            : sc(sc), image_buffer(image_buffer), width(width), height(height), strip_rows(std::clamp(strip_rows, 1u, height)), stride(width)
+        {
+            auto &device = sc.device;
+            strip_pixels = device.create_buffer<uint>((this->strip_rows + 2u) * width);
+            strip_energy = device.create_image<float>(PixelStorage::FLOAT1, width, this->strip_rows, 0u);
+            strip_pred = device.create_image<uint>(PixelStorage::BYTE1, width, this->strip_rows, 0u);
+            frontier[0] = device.create_buffer<float>(width);
+            frontier[1] = device.create_buffer<float>(width);
+            if (spill_path.empty())
+                host_pred.resize(static_cast<size_t>(stride) * this->strip_rows * strip_count());
+            else
+            {
+                spill.open(spill_path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+                // Without the spill file, strip_pred_data would index past the single-strip host_pred.
+                LUISA_ASSERT(spill.is_open(), "Cannot open spill file {}.", spill_path);
+                host_pred.resize(static_cast<size_t>(stride) * this->strip_rows);
+            }
+            host_frontier.resize(width);
+            seam.resize(height);
+        }
+
+        [[nodiscard]] auto strip_count() const noexcept { return (height + strip_rows - 1u) / strip_rows; }
+
+        unsigned char *strip_pred_data(uint strip)
+        {
+            if (spill.is_open())
+                return host_pred.data();
+            return host_pred.data() + static_cast<size_t>(strip) * strip_rows * stride;
+        }
+
+        void delete_seam()
+        {
+            auto &stream = sc.stream;
+            uint current = 0u;
+            stream << sc.zero_shader(frontier[current]).dispatch(width);
+            for (uint strip = 0u; strip < strip_count(); ++strip)
+            {
+                const uint y0 = strip * strip_rows;
+                const uint y1 = std::min(y0 + strip_rows, height);
+                const uint b0 = y0 == 0u ? 0u : y0 - 1u;
+                const uint b1 = std::min(y1 + 1u, height);
+                CommandList cmds;
+                cmds.reserve(y1 - y0 + 3u, 0u);
+                cmds << strip_pixels.view(0u, (b1 - b0) * width).copy_from(image_buffer.data() + static_cast<size_t>(b0) * width * 4u)
+                     << sc.compute_energy(strip_pixels, strip_energy, width, height, b0, y0, y1 - y0);
+                for (uint y = y0; y < y1; ++y)
+                {
+                    cmds << sc.strip_cost_shader(frontier[current], frontier[current ^ 1u], strip_energy, strip_pred, y - y0).dispatch(width);
+                    current ^= 1u;
+                }
+                cmds << strip_pred.copy_to(strip_pred_data(strip));
+                {
+                    StageTrace stage(stream, "strip cost");
+                    stream << cmds.commit() << synchronize();
+                }
+                if (spill.is_open())
+                {
+                    spill.seekp(static_cast<std::streamoff>(strip) * strip_rows * stride);
+                    spill.write(reinterpret_cast<const char *>(host_pred.data()), host_pred.size());
+                    LUISA_ASSERT(spill, "Writing strip {} to the spill file failed.", strip);
+                }
+            }
+            stream << frontier[current].view(0u, width).copy_to(host_frontier.data()) << synchronize();
+
+            // Backtrace from the bottom strip up, reloading spilled strips as needed.
+            {
+                lct::TraceScope scope("backtrace");
+                uint x = static_cast<uint>(std::min_element(host_frontier.begin(), host_frontier.begin() + width) - host_frontier.begin());
+                for (uint strip = strip_count(); strip-- > 0u;)
+                {
+                    const uint y0 = strip * strip_rows;
+                    const uint y1 = std::min(y0 + strip_rows, height);
+                    if (spill.is_open())
+                    {
+                        spill.seekg(static_cast<std::streamoff>(strip) * strip_rows * stride);
+                        spill.read(reinterpret_cast<char *>(host_pred.data()), host_pred.size());
+                        // A short read would backtrace through stale predecessors and leave the image.
+                        LUISA_ASSERT(spill && static_cast<size_t>(spill.gcount()) == host_pred.size(), "Reading strip {} from the spill file failed.", strip);
+                    }
+                    const auto *pred = strip_pred_data(strip);
+                    for (uint y = y1; y-- > y0;)
+                    {
+                        seam[y] = x;
+                        x = x + pred[(y - y0) * stride + x] - 1u;
+                    }
+                }
+            }
+
+            // Close the seam in place: rows only ever move towards the front of the buffer.
+            lct::TraceScope scope("compaction");
+            auto *pixels = image_buffer.data();
+            for (uint y = 0u; y < height; ++y)
+            {
+                auto *src = pixels + static_cast<size_t>(y) * width * 4u;
+                auto *dst = pixels + static_cast<size_t>(y) * (width - 1u) * 4u;
+                std::memmove(dst, src, seam[y] * 4u);
+                std::memmove(dst + seam[y] * 4u, src + (seam[y] + 1u) * 4u, (width - 1u - seam[y]) * 4u);
+            }
+            --width;
+            image_buffer.resize(static_cast<size_t>(width) * height * 4u);
+        }
+    };
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <luisa-compute.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace lct
+{
+    template <typename S>
+    struct shader_loader;
+
+    template <size_t N, typename... Args>
+    struct shader_loader<luisa::compute::Shader<N, Args...>>
+    {
+        static auto load(luisa::compute::Device &device, luisa::string_view name)
+        {
+            return device.template load_shader<N, Args...>(name);
+        }
+    };
+
+    // Compiles the tools' kernels through one place.
+    // - LuisaCompute's on-disk shader cache (keyed by the kernel AST hash and the backend) is on unless
+    //   LCT_SHADER_CACHE=0, so cold and warm start can be compared.
+    // - With precompile set (the tools' --precompile flag), every kernel is compiled ahead of time into a named
+    //   bundle entry "<tool>.<name>-<AST hash>.<backend>" and listed in lct_shaders.manifest next to the binaries.
+    //   Later runs load listed entries instead of compiling; an edited kernel hashes differently and recompiles.
+    //   Entries whose bundle file is gone are dropped from the manifest at startup, so those kernels compile again;
+    //   so are the entries of older hashes when a kernel is precompiled anew.
+    // - fast_math = false keeps IEEE division, sqrt and no contraction, for kernels checked against host code.
+    class ShaderCache
+    {
+        luisa::compute::Device &_device;
+        std::filesystem::path _runtime_directory;
+        std::filesystem::path _manifest_path;
+        std::set<std::string> _bundle;
+        bool _bundle_changed = false;
+        std::string _tool;
+        bool _cache_enabled = true;
+        bool _precompile = false;
+        bool _fast_math = true;
+        luisa::uint _loaded = 0u;
+        luisa::uint _compiled = 0u;
+        double _milliseconds = 0.0;
+
+    public:
+        ShaderCache(luisa::compute::Context &context, luisa::compute::Device &device, std::string_view tool, bool precompile = false, bool fast_math = true)
+            : _device(device), _runtime_directory(context.runtime_directory()), _manifest_path(_runtime_directory / "lct_shaders.manifest"), _tool(tool), _precompile(precompile), _fast_math(fast_math)
+        {
+            if (auto env = std::getenv("LCT_SHADER_CACHE"))
+                _cache_enabled = std::string_view(env) != "0";
+            std::ifstream manifest(_manifest_path);
+            for (std::string line; std::getline(manifest, line);)
+            {
+                if (line.empty())
+                    continue;
+                if (bundled(line))
+                    _bundle.insert(line);
+                else
+                    _bundle_changed = true;
+            }
+        }
+
+        ShaderCache(const ShaderCache &) = delete;
+        ShaderCache &operator=(const ShaderCache &) = delete;
+
+        ~ShaderCache()
+        {
+            if (_precompile || _bundle_changed)
+            {
+                std::ofstream manifest(_manifest_path, std::ios::trunc);
+                for (const auto &entry : _bundle)
+                    manifest << entry << '\n';
+            }
+        }
+
+        void report() const
+        {
+            std::cout << "[" << _tool << "] " << _loaded + _compiled << " shaders ready in " << _milliseconds << " ms ("
+                      << _loaded << " from bundle, " << _compiled << (_precompile ? " precompiled" : " compiled")
+                      << ", disk cache " << (_cache_enabled ? "on" : "off") << ").\n";
+        }
+
+        // Named shaders are written by the backend to the runtime directory under their name.
+        [[nodiscard]] bool bundled(const std::string &key) const
+        {
+            std::error_code error;
+            return std::filesystem::is_regular_file(_runtime_directory / key, error);
+        }
+
+        template <typename Kernel>
+        [[nodiscard]] auto bundle_key(const Kernel &kernel, std::string_view name) const
+        {
+            return luisa::format("{}.{}-{:016x}.{}", _tool, name, kernel.function()->hash(), _device.backend_name());
+        }
+
+        template <typename Kernel>
+        auto compile(const Kernel &kernel, std::string_view name)
+        {
+            using shader_type = decltype(_device.compile(kernel));
+            luisa::Clock clock;
+            clock.tic();
+            auto key = bundle_key(kernel, name);
+            shader_type shader;
+            if (!_precompile && _bundle.contains(std::string(key)))
+            {
+                shader = shader_loader<shader_type>::load(_device, key);
+                ++_loaded;
+            }
+            else
+            {
+                luisa::compute::ShaderOption option;
+                option.enable_cache = _cache_enabled;
+                option.enable_fast_math = _fast_math;
+                if (_precompile)
+                {
+                    option.compile_only = true;
+                    option.name = key;
+                    // Entries of the same kernel under an older AST hash are stale.
+                    const auto prefix = luisa::format("{}.{}-", _tool, name);
+                    const auto suffix = luisa::format(".{}", _device.backend_name());
+                    std::erase_if(_bundle, [&](const std::string &entry)
+                                  { return entry.size() == prefix.size() + 16u + suffix.size() &&
+                                           entry.starts_with(std::string_view(prefix)) && entry.ends_with(std::string_view(suffix)); });
+                    _bundle.insert(std::string(key));
+                }
+                shader = _device.compile(kernel, option);
+                ++_compiled;
+            }
+            _milliseconds += clock.toc();
+            return shader;
+        }
+    };
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lct
+{
+    // Stage timing, off unless LCT_TRACE is set. LCT_TRACE=<path> (1 for lct_trace.json) writes a Chrome/Perfetto
+    // trace at exit and prints a per-stage summary.
+    // - TraceScope records host wall time on the calling thread.
+    // - DeviceTraceScope brackets the commands submitted to a stream with stream callbacks, so it spans from the
+    //   device reaching the first command to the last one completing, on one track per stream.
+    // When tracing is off, both scopes cost a branch on a global.
+    class Trace
+    {
+    public:
+        struct Event
+        {
+            const char *name;
+            const char *category;
+            uint32_t track;
+            double begin_us;
+            double duration_us;
+        };
+
+        static Trace &instance()
+        {
+            static Trace trace;
+            return trace;
+        }
+
+        [[nodiscard]] static bool enabled() noexcept { return _enabled; }
+
+        [[nodiscard]] static double now_us() noexcept
+        {
+            static const auto epoch = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        [[nodiscard]] uint32_t host_track()
+        {
+            thread_local const uint32_t track = [this]
+            {
+                std::lock_guard lock(_mutex);
+                auto id = static_cast<uint32_t>(_track_names.size());
+                _track_names.emplace_back("host thread " + std::to_string(id));
+                return id;
+            }();
+            return track;
+        }
+
+        [[nodiscard]] uint32_t device_track(const void *stream)
+        {
+            std::lock_guard lock(_mutex);
+            auto [iter, inserted] = _device_tracks.try_emplace(stream, static_cast<uint32_t>(_track_names.size()));
+            if (inserted)
+                _track_names.emplace_back("device stream " + std::to_string(_device_tracks.size() - 1u));
+            return iter->second;
+        }
+
+        void record(const Event &event)
+        {
+            std::lock_guard lock(_mutex);
+            _events.push_back(event);
+        }
+
+        ~Trace()
+        {
+            if (_enabled && !_events.empty())
+            {
+                write_json();
+                print_summary();
+            }
+        }
+
+    private:
+        inline static const bool _enabled = std::getenv("LCT_TRACE") != nullptr;
+        std::mutex _mutex;
+        std::vector<Event> _events;
+        std::vector<std::string> _track_names;
+        std::map<const void *, uint32_t> _device_tracks;
+
+        Trace() { _events.reserve(1u << 16u); }
+
+        void write_json() const
+        {
+            std::string path = std::getenv("LCT_TRACE");
+            if (path.empty() || path == "1")
+                path = "lct_trace.json";
+            std::ofstream file(path);
+            file << "{\"traceEvents\":[\n";
+            for (size_t i = 0u; i < _track_names.size(); ++i)
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"" << _track_names[i] << "\"}},\n";
+            file << std::fixed << std::setprecision(3);
+            for (size_t i = 0u; i < _events.size(); ++i)
+            {
+                const auto &e = _events[i];
+                file << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.track
+                     << ",\"ts\":" << e.begin_us << ",\"dur\":" << e.duration_us << "}" << (i + 1u < _events.size() ? ",\n" : "\n");
+            }
+            file << "]}\n";
+            std::cout << "[trace] " << _events.size() << " events written to " << path << ".\n";
+        }
+
+        void print_summary() const
+        {
+            struct Stats
+            {
+                uint64_t count = 0u;
+                double total_us = 0.0;
+                double max_us = 0.0;
+            };
+            std::map<std::pair<std::string, std::string>, Stats> stages;
+            for (const auto &e : _events)
+            {
+                auto &stats = stages[{e.category, e.name}];
+                ++stats.count;
+                stats.total_us += e.duration_us;
+                stats.max_us = std::max(stats.max_us, e.duration_us);
+            }
+            std::vector<std::pair<std::pair<std::string, std::string>, Stats>> rows(stages.begin(), stages.end());
+            std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b)
+                      { return a.second.total_us > b.second.total_us; });
+            std::cout << std::left << std::setw(8) << "where" << std::setw(28) << "stage" << std::right << std::setw(10) << "count"
+                      << std::setw(14) << "total ms" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << "\n";
+            std::cout << std::fixed << std::setprecision(3);
+            for (const auto &[key, stats] : rows)
+                std::cout << std::left << std::setw(8) << key.first << std::setw(28) << key.second << std::right << std::setw(10) << stats.count
+                          << std::setw(14) << stats.total_us / 1000.0 << std::setw(12) << stats.total_us / 1000.0 / stats.count
+                          << std::setw(12) << stats.max_us / 1000.0 << "\n";
+            std::cout << std::defaultfloat;
+        }
+    };
+
+    // `name` must outlive the trace; string literals are the intended use.
+    class TraceScope
+    {
+        const char *_name = nullptr;
+        double _begin_us = 0.0;
+
+    public:
+        explicit TraceScope(const char *name) noexcept
+        {
+            if (!Trace::enabled())
+                return;
+            _name = name;
+            _begin_us = Trace::now_us();
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+        ~TraceScope()
+        {
+            if (_name == nullptr)
+                return;
+            auto &trace = Trace::instance();
+            trace.record({_name, "host", trace.host_track(), _begin_us, Trace::now_us() - _begin_us});
+        }
+    };
+
+    template <typename Stream>
+    class DeviceTraceScope
+    {
+        Stream *_stream = nullptr;
+        const char *_name = nullptr;
+        std::shared_ptr<double> _begin_us;
+
+    public:
+        DeviceTraceScope(Stream &stream, const char *name)
+        {
+            if (!Trace::enabled())
+                return;
+            _stream = &stream;
+            _name = name;
+            _begin_us = std::make_shared<double>(0.0);
+            stream << [begin_us = _begin_us]
+            { *begin_us = Trace::now_us(); };
+        }
+
+        DeviceTraceScope(const DeviceTraceScope &) = delete;
+        DeviceTraceScope &operator=(const DeviceTraceScope &) = delete;
+
+        ~DeviceTraceScope()
+        {
+            if (_stream == nullptr)
+                return;
+            auto track = Trace::instance().device_track(_stream);
+            *_stream << [begin_us = _begin_us, name = _name, track]
+            { Trace::instance().record({name, "device", track, *begin_us, Trace::now_us() - *begin_us}); };
+        }
+    };
+
+    // Host submission time and device execution time of one stage, under the same name.
+    template <typename Stream>
+    class StageTraceScope
+    {
+        TraceScope _host;
+        DeviceTraceScope<Stream> _device;
+
+    public:
+        StageTraceScope(Stream &stream, const char *name) : _host(name), _device(stream, name) {}
+    };
+}
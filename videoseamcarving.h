@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <hostseamcarving.h>
+#include <trace.h>
+
+// Vertical seam carving of a frame sequence to a fixed width on the host, with seams that stay put from frame to
+// frame instead of jittering.
+// - The first frame, and any frame in which more than scene_cut of the pixels changed, is a keyframe and is carved
+//   exactly like HostSeamCarving::delete_seam.
+// - Otherwise a pixel counts as changed when its luminance moved by more than threshold since the previous frame,
+//   and the frame's energy is only recomputed where a 3x3 Sobel window sees a changed pixel.
+// - Seam s is searched only within `window` pixels of the previous frame's seam s in every row, by a cost DP over
+//   that band. While all earlier seams of the frame came out as in the previous frame, the image around seam s has
+//   the same layout as before; if no changed pixel lies in its band (plus the Sobel apron), its energy is the same
+//   too and the previous seam is taken as is, without a DP.
+class VideoSeamCarving
+{
+public:
+    struct Options
+    {
+        uint32_t window = 8u;
+        float threshold = 2.0f / 255.0f;
+        float scene_cut = 0.5f;
+    };
+
+    struct FrameStats
+    {
+        bool keyframe = false;
+        // Fractions of the pixels that changed and whose energy was recomputed.
+        float changed = 0.0f;
+        float energy = 0.0f;
+        uint32_t reused = 0u;
+        uint32_t searched = 0u;
+    };
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t target_width;
+
+    VideoSeamCarving(uint32_t width, uint32_t height, uint32_t target_width, Options options)
+        : width(width), height(height), target_width(std::clamp(target_width, 1u, width)), _options(options)
+    {
+        const size_t pixels = static_cast<size_t>(width) * height;
+        _frame_luminance.resize(pixels);
+        _frame_energy.resize(pixels);
+        _changed.resize(pixels);
+        _row_changed.resize(height);
+        _pixels.resize(pixels);
+        _luminance.resize(pixels);
+        _energy.resize(pixels);
+        _origin.resize(pixels);
+        // The cost planes hold either the full DP or a band of 2 * window + 1 columns per row.
+        const size_t cost_pixels = std::max<size_t>(width, 2u * static_cast<size_t>(options.window) + 1u) * height;
+        _cost.resize(cost_pixels);
+        _pred.resize(cost_pixels);
+        _seams.resize(static_cast<size_t>(width - this->target_width) * height);
+        _next_seams.resize(_seams.size());
+    }
+
+    // Carves one frame of width x height RGBA8 pixels to target_width x height.
+    FrameStats carve(const unsigned char *frame, std::vector<unsigned char> &result)
+    {
+        FrameStats stats;
+        const size_t pixels = static_cast<size_t>(width) * height;
+        std::memcpy(_pixels.data(), frame, pixels * 4u);
+        stats.changed = detect_changes();
+        stats.keyframe = !_has_previous || stats.changed > _options.scene_cut;
+        stats.energy = update_frame_energy(stats.keyframe);
+        _has_previous = true;
+
+        std::copy(_frame_luminance.begin(), _frame_luminance.end(), _luminance.begin());
+        std::copy(_frame_energy.begin(), _frame_energy.end(), _energy.begin());
+#pragma omp parallel for
+        for (int64_t j = 0; j < static_cast<int64_t>(height); ++j)
+            for (uint32_t i = 0u; i < width; ++i)
+                _origin[static_cast<size_t>(j) * width + i] = i;
+
+        bool same_layout = !stats.keyframe;
+        for (uint32_t s = 0u; s < width - target_width; ++s)
+        {
+            const uint32_t n = width - s;
+            const uint32_t *previous = _seams.data() + static_cast<size_t>(s) * height;
+            uint32_t *seam = _next_seams.data() + static_cast<size_t>(s) * height;
+            if (stats.keyframe)
+                search_full(n, seam);
+            else if (same_layout && band_unchanged(previous, n))
+            {
+                std::copy(previous, previous + height, seam);
+                ++stats.reused;
+            }
+            else
+            {
+                search_band(previous, n, seam);
+                same_layout = same_layout && std::equal(seam, seam + height, previous);
+                ++stats.searched;
+            }
+            remove_seam(seam, n);
+        }
+        std::swap(_seams, _next_seams);
+
+        result.resize(static_cast<size_t>(target_width) * height * 4u);
+        std::memcpy(result.data(), _pixels.data(), result.size());
+        return stats;
+    }
+
+private:
+    Options _options;
+    bool _has_previous = false;
+    // Luminance and energy of the last frame at full width, carried over to the next one.
+    std::vector<float> _frame_luminance;
+    std::vector<float> _frame_energy;
+    std::vector<uint8_t> _changed;
+    std::vector<uint8_t> _row_changed;
+    // The frame being carved, tightly packed at its current width. _origin holds every pixel's column in the frame.
+    std::vector<uint32_t> _pixels;
+    std::vector<float> _luminance;
+    std::vector<float> _energy;
+    std::vector<uint32_t> _origin;
+    std::vector<float> _cost;
+    std::vector<uint8_t> _pred;
+    // Seam s of a frame is stored at s * height, in the coordinates of the image it was removed from.
+    std::vector<uint32_t> _seams;
+    std::vector<uint32_t> _next_seams;
+
+    // Marks the pixels whose luminance moved by more than the threshold and takes their new luminance. The others keep
+    // the luminance their energy was computed from, so slow drifts still add up to a change and the energy always
+    // matches the luminance it is carved with. Returns the changed fraction.
+    float detect_changes()
+    {
+        lct::TraceScope scope("video changes");
+        const float threshold = _options.threshold;
+        const bool compare = _has_previous;
+        int64_t changed = 0;
+#pragma omp parallel for reduction(+ : changed)
+        for (int64_t j = 0; j < static_cast<int64_t>(height); ++j)
+        {
+            uint32_t row_changed = 0u;
+            for (uint32_t i = 0u; i < width; ++i)
+            {
+                const size_t index = static_cast<size_t>(j) * width + i;
+                const float l = HostSeamCarving::luminance(_pixels[index]);
+                const bool c = !compare || std::abs(l - _frame_luminance[index]) > threshold;
+                if (c)
+                    _frame_luminance[index] = l;
+                _changed[index] = c;
+                row_changed += c;
+            }
+            _row_changed[j] = row_changed > 0u;
+            changed += row_changed;
+        }
+        return static_cast<float>(static_cast<double>(changed) / (static_cast<double>(width) * height));
+    }
+
+    // Recomputes the frame energy wherever a changed pixel lies in the 3x3 window. Returns the recomputed fraction.
+    float update_frame_energy(bool all)
+    {
+        lct::TraceScope scope("video energy");
+        int64_t updated = 0;
+#pragma omp parallel for reduction(+ : updated)
+        for (int64_t sj = 0; sj < static_cast<int64_t>(height); ++sj)
+        {
+            const auto j = static_cast<uint32_t>(sj);
+            const uint32_t j0 = j > 0u ? j - 1u : 0u;
+            const uint32_t j1 = std::min(j + 1u, height - 1u);
+            if (!all && !_row_changed[j0] && !_row_changed[j] && !_row_changed[j1])
+                continue;
+            for (uint32_t i = 0u; i < width; ++i)
+            {
+                bool stale = all;
+                const uint32_t i0 = i > 0u ? i - 1u : 0u;
+                const uint32_t i1 = std::min(i + 1u, width - 1u);
+                for (uint32_t y = j0; y <= j1 && !stale; ++y)
+                    for (uint32_t x = i0; x <= i1 && !stale; ++x)
+                        stale = _changed[static_cast<size_t>(y) * width + x] != 0u;
+                if (stale)
+                {
+                    _frame_energy[static_cast<size_t>(j) * width + i] = HostSeamCarving::sobel(_frame_luminance.data(), width, height, i, j);
+                    ++updated;
+                }
+            }
+        }
+        return static_cast<float>(static_cast<double>(updated) / (static_cast<double>(width) * height));
+    }
+
+    // Whether no changed pixel lies within window + 2 columns of the previous seam in any row: the band the DP would
+    // search, its Sobel apron, and the one-column drift of the band between neighbouring rows.
+    [[nodiscard]] bool band_unchanged(const uint32_t *previous, uint32_t n) const noexcept
+    {
+        const int reach = static_cast<int>(_options.window) + 2;
+        for (uint32_t j = 0u; j < height; ++j)
+        {
+            const int c = static_cast<int>(previous[j]);
+            const size_t row = static_cast<size_t>(j) * n;
+            for (int i = std::max(c - reach, 0); i <= std::min(c + reach, static_cast<int>(n) - 1); ++i)
+                if (_changed[static_cast<size_t>(j) * width + _origin[row + i]] != 0u)
+                    return false;
+        }
+        return true;
+    }
+
+    // The unconstrained seam of HostSeamCarving: full cost DP and the first minimum of the last row.
+    void search_full(uint32_t n, uint32_t *seam)
+    {
+        lct::TraceScope scope("video full seam");
+        std::copy(_energy.begin(), _energy.begin() + n, _cost.begin());
+        for (uint32_t j = 1u; j < height; ++j)
+        {
+            const size_t row = static_cast<size_t>(j) * n;
+            HostSeamCarving::cost_row(_cost.data() + row - n, _energy.data() + row, _cost.data() + row, _pred.data() + row, n);
+        }
+        const float *last = _cost.data() + static_cast<size_t>(height - 1u) * n;
+        uint32_t i = static_cast<uint32_t>(std::min_element(last, last + n) - last);
+        seam[height - 1u] = i;
+        for (uint32_t j = height - 1u; j > 0u; --j)
+        {
+            i = i + _pred[static_cast<size_t>(j) * n + i] - 1u;
+            seam[j - 1u] = i;
+        }
+    }
+
+    // Cost DP over columns [c - window, c + window] of every row, c being the previous seam there. The band is
+    // stored with row pitch 2 * window + 1; columns outside the image cost infinity. Ties resolve as in cost_row.
+    void search_band(const uint32_t *previous, uint32_t n, uint32_t *seam)
+    {
+        lct::TraceScope scope("video band seam");
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        const int w = static_cast<int>(_options.window);
+        const int band = 2 * w + 1;
+        auto column = [&](uint32_t j, int t)
+        { return static_cast<int>(previous[j]) - w + t; };
+        for (int t = 0; t < band; ++t)
+        {
+            const int i = column(0u, t);
+            _cost[t] = i >= 0 && i < static_cast<int>(n) ? _energy[i] : inf;
+        }
+        for (uint32_t j = 1u; j < height; ++j)
+        {
+            const float *p = _cost.data() + static_cast<size_t>(j - 1u) * band;
+            float *c = _cost.data() + static_cast<size_t>(j) * band;
+            uint8_t *pred = _pred.data() + static_cast<size_t>(j) * band;
+            const int shift = static_cast<int>(previous[j]) - static_cast<int>(previous[j - 1u]);
+            for (int t = 0; t < band; ++t)
+            {
+                const int i = column(j, t);
+                if (i < 0 || i >= static_cast<int>(n))
+                {
+                    c[t] = inf;
+                    pred[t] = 1u;
+                    continue;
+                }
+                // Column i is at t + shift in the previous row's band.
+                auto at = [&](int dt)
+                {
+                    const int u = t + shift + dt;
+                    const int x = i + dt;
+                    return u >= 0 && u < band && x >= 0 && x < static_cast<int>(n) ? p[u] : inf;
+                };
+                const float lt = at(-1);
+                const float rt = at(1);
+                float best = at(0);
+                uint8_t pr = 1u;
+                if (lt < best)
+                {
+                    best = lt;
+                    pr = 0u;
+                }
+                if (rt < best)
+                {
+                    best = rt;
+                    pr = 2u;
+                }
+                c[t] = _energy[static_cast<size_t>(j) * n + i] + best;
+                pred[t] = pr;
+            }
+        }
+        const float *last = _cost.data() + static_cast<size_t>(height - 1u) * band;
+        int t = static_cast<int>(std::min_element(last, last + band) - last);
+        seam[height - 1u] = static_cast<uint32_t>(column(height - 1u, t));
+        for (uint32_t j = height - 1u; j > 0u; --j)
+        {
+            const int i = column(j, t) + _pred[static_cast<size_t>(j) * band + t] - 1;
+            t = i - column(j - 1u, 0);
+            seam[j - 1u] = static_cast<uint32_t>(i);
+        }
+    }
+
+    template <typename T>
+    void close_seam(std::vector<T> &plane, const uint32_t *seam, uint32_t n) const
+    {
+        lct::StridedImageView<T>{plane.data(), n, height, n}.close_vertical_seam(seam);
+    }
+
+    // As HostSeamCarving::remove_seam: close the seam in every plane, then refresh the energy band [s - 2, s + 1].
+    void remove_seam(const uint32_t *seam, uint32_t n)
+    {
+        lct::TraceScope scope("video remove seam");
+        close_seam(_pixels, seam, n);
+        close_seam(_luminance, seam, n);
+        close_seam(_energy, seam, n);
+        close_seam(_origin, seam, n);
+#pragma omp parallel for
+        for (int64_t j = 0; j < static_cast<int64_t>(height); ++j)
+        {
+            const int s = static_cast<int>(seam[j]);
+            const int begin = std::max(s - 2, 0);
+            const int end = std::min(s + 1, static_cast<int>(n) - 2);
+            for (int i = begin; i <= end; ++i)
+                _energy[static_cast<size_t>(j) * (n - 1u) + i] = HostSeamCarving::sobel(_luminance.data(), n - 1u, height, static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+        }
+    }
+};
@@ -1,16 +1,62 @@
 #include <iostream>
 
 #include <luisa-compute.h>
+#include <backend.h>
+#include <shadercache.h>
+#include <trace.h>
+#include <frameloop.h>
 
 using namespace luisa;
 using namespace luisa::compute;
 
-int main(int, char** argv){
+int main(int argc, char** argv){
+    bool precompile = false;
+    lct::FrameLoopOptions frame_loop;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string_view(argv[i]) == "--precompile")
+            precompile = true;
+        else if (!frame_loop.parse(argc, argv, i))
+        {
+            std::cerr << "Unknown option or missing value: " << argv[i] << "\n"
+                      << "Usage: wt [--precompile] " << lct::FrameLoopOptions::usage << "\n";
+            return 1;
+        }
+    }
     Context context{argv[0]};
-    Device device = context.create_device("cuda");
+    Device device = lct::create_device(context);
     Stream stream = device.create_stream(StreamTag::GRAPHICS);
 
     uint2 resolution = make_uint2(800u, 600u);
+    Kernel2D kernel = [&](ImageFloat image, Float time) noexcept {
+        Var coord = dispatch_id().xy();
+        Var screen_coord = make_float2(coord) / make_float2(resolution);
+        Var initial_amp = make_float3(screen_coord, 1.0f);
+        // (cos(phi) + 1) / 2 = initial_amp
+        Var initial_phase = acos(initial_amp * 2.0f - 1.0f);
+        Var wt_phi = 2.0f * pi / 1000.0f * time + initial_phase;
+        image.write(coord, make_float4((cos(wt_phi) + 1.0f) / 2.0f, 1.0f));
+    };
+    lct::ShaderCache cache(context, device, "wt", precompile);
+    auto shader = cache.compile(kernel, "wave");
+    cache.report();
+    if (precompile) return 0;
+
+    if (frame_loop.frames > 0u)
+    {
+        lct::HeadlessFrameLoop<Stream> loop(stream, frame_loop.ring);
+        std::vector<Image<float>> back_buffers;
+        for (uint32_t i = 0u; i < loop.ring(); ++i)
+            back_buffers.emplace_back(device.create_image<float>(PixelStorage::BYTE4, resolution));
+        Clock clock;
+        clock.tic();
+        loop.run(frame_loop.frames, [&](CommandList &cmds, uint32_t, uint32_t slot) {
+            cmds << shader(back_buffers[slot], static_cast<float>(clock.toc())).dispatch(resolution);
+        });
+        loop.report("wt");
+        return 0;
+    }
+
     Window window("Test Window", resolution);
     Swapchain swpchain = device.create_swapchain(stream, SwapchainOption{
         .display = window.native_display(),
@@ -22,24 +68,12 @@ int main(int, char** argv){
     });
     Image<float> display = device.create_image<float>(swpchain.backend_storage(), resolution);
 
-    Kernel2D kernel = [&](ImageFloat image, Float time) noexcept {
-        Var coord = dispatch_id().xy();
-        Var screen_coord = make_float2(coord) / make_float2(resolution);
-        Var initial_amp = make_float3(screen_coord, 1.0f);
-        // (cos(phi) + 1) / 2 = initial_amp
-        Var initial_phase = acos(initial_amp * 2.0f - 1.0f);
-        Var wt_phi = 2.0f * pi / 1000.0f * time + initial_phase;
-        image.write(coord, make_float4((cos(wt_phi) + 1.0f) / 2.0f, 1.0f));
-    };
-    auto shader = device.compile(kernel);
-
     Clock clock;
     clock.tic();
     while(!window.should_close())
     {
         window.poll_events();
-        CommandList cmds;
-        cmds.reserve(1u, 0u);
+        lct::StageTraceScope<Stream> stage(stream, "frame");
         stream << shader(display, clock.toc()).dispatch(resolution) << swpchain.present(display);
     }
     stream << synchronize();
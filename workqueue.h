@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace lct
+{
+    // Multi-producer, multi-consumer queue with a fixed capacity. push blocks while the queue is full, which is what
+    // throttles the faster stages of a pipeline. After close(), pop drains what is left and then returns nullopt.
+    template <typename T>
+    class BoundedQueue
+    {
+        std::mutex _mutex;
+        std::condition_variable _not_full;
+        std::condition_variable _not_empty;
+        std::deque<T> _items;
+        size_t _capacity;
+        bool _closed = false;
+
+    public:
+        explicit BoundedQueue(size_t capacity) : _capacity(std::max<size_t>(capacity, 1u)) {}
+
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        bool push(T item)
+        {
+            std::unique_lock lock(_mutex);
+            _not_full.wait(lock, [this]
+                           { return _closed || _items.size() < _capacity; });
+            if (_closed)
+                return false;
+            _items.push_back(std::move(item));
+            lock.unlock();
+            _not_empty.notify_one();
+            return true;
+        }
+
+        std::optional<T> pop()
+        {
+            std::unique_lock lock(_mutex);
+            _not_empty.wait(lock, [this]
+                            { return _closed || !_items.empty(); });
+            if (_items.empty())
+                return std::nullopt;
+            T item = std::move(_items.front());
+            _items.pop_front();
+            lock.unlock();
+            _not_full.notify_one();
+            return item;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _closed = true;
+            }
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+    };
+
+    // Persistent threads running batches of independent tasks. run() deals the tasks round-robin onto per-thread
+    // deques; each thread pops its own deque from the back and, once that is empty, steals from the front of the
+    // others, so uneven task costs even out without a shared queue.
+    class WorkStealingPool
+    {
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<uint32_t> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        // Set before the tasks of a run are dealt, and a task is only popped under its deque's lock, so a worker
+        // always sees the body that belongs to the task it popped.
+        std::atomic<const std::function<void(uint32_t)> *> _body{nullptr};
+        std::atomic<size_t> _pending{0u};
+        uint64_t _generation = 0u;
+        bool _stop = false;
+
+        std::optional<uint32_t> next_task(size_t self)
+        {
+            {
+                auto &own = *_workers[self];
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty())
+                {
+                    auto task = own.tasks.back();
+                    own.tasks.pop_back();
+                    return task;
+                }
+            }
+            for (size_t i = 1u; i < _workers.size(); ++i)
+            {
+                auto &victim = *_workers[(self + i) % _workers.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    auto task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return task;
+                }
+            }
+            return std::nullopt;
+        }
+
+        void work(size_t self)
+        {
+            uint64_t seen = 0u;
+            while (true)
+            {
+                {
+                    std::unique_lock lock(_mutex);
+                    _start.wait(lock, [&]
+                                { return _stop || _generation != seen; });
+                    if (_stop)
+                        return;
+                    seen = _generation;
+                }
+                while (auto task = next_task(self))
+                {
+                    (*_body.load())(*task);
+                    if (_pending.fetch_sub(1u) == 1u)
+                    {
+                        std::lock_guard lock(_mutex);
+                        _done.notify_all();
+                    }
+                }
+            }
+        }
+
+    public:
+        explicit WorkStealingPool(size_t threads = std::thread::hardware_concurrency())
+        {
+            threads = std::max<size_t>(threads, 1u);
+            for (size_t i = 0u; i < threads; ++i)
+                _workers.push_back(std::make_unique<Worker>());
+            for (size_t i = 0u; i < threads; ++i)
+                _threads.emplace_back([this, i]
+                                      { work(i); });
+        }
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        ~WorkStealingPool()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stop = true;
+            }
+            _start.notify_all();
+            for (auto &thread : _threads)
+                thread.join();
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return _threads.size(); }
+
+        // Calls body(task) for every task and returns when all have finished.
+        void run(const std::vector<uint32_t> &tasks, const std::function<void(uint32_t)> &body)
+        {
+            if (tasks.empty())
+                return;
+            _body = &body;
+            _pending = tasks.size();
+            for (size_t i = 0u; i < tasks.size(); ++i)
+            {
+                auto &worker = *_workers[i % _workers.size()];
+                std::lock_guard lock(worker.mutex);
+                worker.tasks.push_back(tasks[i]);
+            }
+            std::unique_lock lock(_mutex);
+            ++_generation;
+            _start.notify_all();
+            _done.wait(lock, [this]
+                       { return _pending.load() == 0u; });
+        }
+    };
+}